@@ -1,7 +1,6 @@
 let chan = '';
 let nick = '';
 let color = '';
-let otherColor = '';
 
 function formIsValid(form) {
   let isValid = true;
@@ -18,23 +17,17 @@ function getRandColor() {
   return '#' + Math.floor(Math.random() * 16777215).toString(16);
 }
 
-function appendMsg(user, userColor, msg) {
-  $('.messages').append(`<p><span style="color:${userColor};text-shadow:0 0 1rem ${userColor};">${user}: </span></p>`);
-  $('.messages p:last-child').append(document.createTextNode(msg));
-  $('.messages').scrollTop($('.messages')[0].scrollHeight);
+// html is a batch of pre-escaped <p> lines rendered by the client, inserted in one go
+function appendHtml(html) {
+  if (!html) return;
+  const messages = $('.messages')[0];
+  messages.insertAdjacentHTML('beforeend', html);
+  messages.scrollTop = messages.scrollHeight;
 }
 
 function getMsg() {
-  const nextMsg = irc.getNextMessage();
-  if (nextMsg) {
-    const json = JSON.parse(nextMsg);
-    if (json.command == 'PRIVMSG' && json.nick && json.nick != nick) {
-      if (!otherColor) {
-        otherColor = getRandColor();
-      }
-      appendMsg(json.nick, otherColor, json.trailing);
-    }
-  }
+  // only the channel on screen is drained, other conversations just keep unread counters
+  appendHtml(irc.renderTargetMessages(chan, 100));
 }
 
 $('#input-color').val(getRandColor());
@@ -64,18 +57,20 @@ $('#btn-register').on('click', (e) => {
   const name = $('#input-name').val();
   nick = $('#input-nick').val();
   color = $('#input-color').val();
+  $('.messages').css({'--own-color': color, '--other-color': getRandColor()});
 
+  // registration goes out when the socket opens, the join is held until the server welcomes us
   module.openWebSocket(url, port);
-  setTimeout(() => {
-    irc.registerUser(user, host, server, name, nick);
-    setTimeout(() => {
-      irc.join([chan], [chanKey])
-    }, 1500);
-    $('.chan').append(chan);
-    $('#form-register-user').removeClass('visible');
-    $('#form-send-msg').addClass('visible');
-    setInterval(() => getMsg(), 250);
-  }, 1500);
+  irc.registerUser(user, host, server, name, nick);
+  irc.join([chan], [chanKey]);
+  irc.subscribe(chan);
+  $('.chan').append(chan);
+  $('#form-register-user').removeClass('visible');
+  $('#form-send-msg').addClass('visible');
+  setInterval(() => {
+    nick = irc.getNick() || nick;
+    getMsg();
+  }, 250);
 
 });
 
@@ -85,7 +80,7 @@ $('#btn-send').on('click', (e) => {
   const inputMsg = $('#input-msg');
   if (inputMsg.val()) {
     irc.privmsg(inputMsg.val());
-    appendMsg(nick, color, inputMsg.val());
+    appendHtml(irc.renderOwnMessage(inputMsg.val()));
     inputMsg.val('');
   };
 });
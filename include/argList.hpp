@@ -0,0 +1,16 @@
+#ifndef ARG_LIST
+#define ARG_LIST
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// list arguments (channels, nicks, masks...) as views, either over a JS array converted by embind
+// or over one delimited buffer parsed in place
+typedef std::vector<std::string_view> argList;
+
+argList views(const std::vector<std::string> &items);
+void splitArgs(std::string_view buffer, argList &out);
+void appendJoined(std::string &msg, const argList &items, char sep);
+void splitText(std::string_view text, size_t fit, argList &pieces);
+#endif
@@ -0,0 +1,23 @@
+#ifndef BACKOFF
+#define BACKOFF
+
+#include <cstdint>
+#include <random>
+
+// Delays between reconnect attempts, doubling from the initial delay up to the maximum.
+// Each delay is drawn from its upper half so clients dropped by the same gateway restart do not all come back at once
+class backoff {
+   public:
+    backoff();
+    void configure(uint64_t initialMs, uint64_t maxMs);
+    bool enabled();
+    uint64_t next();
+    void reset();
+    uint32_t attempts();
+
+   private:
+    uint64_t initial, max;  // ms, initial 0 turns reconnecting off
+    uint32_t tries;
+    std::minstd_rand random;
+};
+#endif
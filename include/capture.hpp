@@ -0,0 +1,48 @@
+#ifndef CAPTURE
+#define CAPTURE
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// On-disk traffic capture.
+//  <file>   ::= <magic "IRCCAP01"> <start: u64 little endian, unix microseconds> { <record> }
+//  <record> ::= <varint microseconds since previous record> <varint connection> <varint length> <raw line>
+// varints are unsigned LEB128, lines are stored as received, before charset decoding, without CR/LF
+class capture {
+   public:
+    struct record {
+        uint64_t time;  // microseconds since capture start
+        uint32_t connection;
+        std::string line;
+    };
+
+    capture();
+    ~capture();
+
+    bool open(std::string path);
+    void close();
+    bool isOpen();
+    void write(uint32_t connection, std::string_view line);
+
+    class reader {
+       public:
+        reader();
+        ~reader();
+        bool open(std::string path);
+        bool next(record &rec);
+        uint64_t start;  // unix microseconds
+
+       private:
+        FILE *file;
+        uint64_t time;
+        bool readVarint(uint64_t &value);
+    };
+
+   private:
+    FILE *file;
+    uint64_t begin, last;  // steady clock microseconds
+    void writeVarint(uint64_t value);
+};
+#endif
@@ -0,0 +1,57 @@
+#ifndef CHANNEL_DIRECTORY
+#define CHANNEL_DIRECTORY
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memoryUsage.hpp"
+#include "message.hpp"
+
+// Compact store of a LIST reply (321/322/323).
+// Names and topics live in one arena, rows are fixed size and a hash index on the folded name
+// dedupes them, so 50k+ channels never turn into per-row objects. Pages can be queried while rows stream in
+class channelDirectory {
+   public:
+    channelDirectory();
+    bool offer(message &m);
+    void reset();
+    std::string getPage(std::string filter, std::string sort, size_t offset, size_t count);
+    void setCasemapping(const unsigned char *table);
+    void setBudget(size_t bytes);
+    memoryUsage usage();
+
+   private:
+    struct entry {
+        uint32_t name, topic;
+        uint16_t nameLen, topicLen;
+        uint32_t users;
+    };
+
+    const unsigned char *fold;  // 256 entry casefold table
+    std::string arena;
+    size_t deadBytes;  // arena bytes of replaced topics
+    std::vector<entry> entries;
+    std::vector<uint32_t> slots;  // open addressing, entry index + 1, 0 is empty
+    bool complete;
+    memoryUsage stats;
+
+    // cached result of the last query, extended incrementally as rows arrive
+    std::string viewFilter, viewSort;
+    std::vector<uint32_t> view;
+    size_t viewed;
+    bool dirty;
+
+    std::string_view nameOf(const entry &e) const;
+    std::string_view topicOf(const entry &e) const;
+    uint32_t hash(std::string_view name);
+    int64_t find(std::string_view name);
+    void insert(std::string_view name, uint32_t users, std::string_view topic);
+    void retopic(entry &e, std::string_view topic);
+    void compact();
+    void grow();
+    bool matches(const entry &e, const std::string &filter, bool glob);
+    bool before(uint32_t a, uint32_t b);
+};
+#endif
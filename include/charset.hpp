@@ -0,0 +1,35 @@
+#ifndef CHARSET
+#define CHARSET
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class charset {
+   public:
+    // legacy encodings a line is assumed to be in when it is not valid UTF-8
+    enum legacy { LATIN1,
+                  CP1252 };
+
+    charset(legacy fallback = CP1252);
+
+    static bool isAscii(const char *data, size_t len);
+    static bool isUtf8(const char *data, size_t len);
+
+    std::string_view decode(const char *data, size_t len);
+    bool setFallback(std::string name);
+    void setFallback(legacy fallback);
+    size_t memorySize();
+    void trim();
+
+    // number of lines that needed transcoding since construction
+    uint32_t transcoded;
+
+   private:
+    legacy fallback;
+    std::string buffer;
+
+    void transcode(const char *data, size_t len);
+};
+#endif
@@ -0,0 +1,59 @@
+#ifndef EVENT_BUFFER
+#define EVENT_BUFFER
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "internPool.hpp"
+#include "memoryUsage.hpp"
+#include "message.hpp"
+
+// Parsed messages as columns in linear memory, for consumers that read batches through typed array views
+// instead of one JSON object per message.
+// A ring of capacity events (a power of two): command id, sender and target intern pool ids, time and the
+// offset and length of its text in a byte ring. Event n lives in slot n & (capacity - 1), header[COMMIT] is
+// one past the newest, header[OLDEST] the oldest still readable, both count up and wrap at 2^32.
+// Text is never split, when it does not fit before the end of the text ring it starts over at 0 and
+// header[GENERATION] is bumped; events are dropped oldest first as their slot or their text is reused.
+// Sender and target ids are retained while their event is readable
+class eventBuffer {
+   public:
+    enum headerField { COMMIT,
+                       OLDEST,
+                       GENERATION,
+                       CAPACITY,
+                       TEXT_BYTES,
+                       HEADER_SIZE = 8 };
+
+    eventBuffer(internPool &pool);
+    void configure(size_t events, size_t textBytes);
+    bool enabled();
+    void push(const message &m, double time);
+    size_t size();
+    void clear();
+    static int32_t commandId(std::string_view command);
+    static std::string commandTable();
+    void refs(std::unordered_map<uint32_t, uint32_t> &held) const;
+    memoryUsage usage();
+
+    // columns, the pointers stay put until the next configure
+    std::vector<int32_t> header;
+    std::vector<int32_t> commands, senders, targets, textOffsets, textLengths;
+    std::vector<double> times;  // unix ms
+    std::string text;
+
+   private:
+    internPool &pool;
+    uint32_t head, oldest, mask;  // event numbers
+    uint32_t textHead;            // where the next text goes
+    size_t textLive;              // text bytes of readable events
+    uint64_t dropped;
+
+    void place(size_t len);
+    void drop();
+    void publish();
+};
+#endif
@@ -0,0 +1,22 @@
+#ifndef FRAMER
+#define FRAMER
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class framer {
+   public:
+    framer(bool stream = false);
+    void feed(const char *data, size_t len, std::vector<std::string_view> &lines);
+    void reset();
+    size_t memorySize();
+    void trim();
+
+   private:
+    // stream: input is a byte stream (TCP, captures) and an unterminated tail waits for the next feed
+    // otherwise every chunk is a complete websocket message and its tail is a line of its own
+    bool stream;
+    std::string partial, joined;
+};
+#endif
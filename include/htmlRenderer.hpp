@@ -0,0 +1,34 @@
+#ifndef HTML_RENDERER
+#define HTML_RENDERER
+
+#include <string>
+#include <string_view>
+
+#include "memoryUsage.hpp"
+
+// Renders conversation lines into one HTML fragment, a whole batch is inserted by the UI with a single
+// insertAdjacentHTML call instead of a DOM node per message.
+// mIRC formatting becomes spans: \x02 bold, \x1D italic, \x1F underline, \x03<fg>[,<bg>] colours, \x0F reset,
+// other control bytes are dropped. Text is escaped and links are wrapped in anchors, all in one pass per line
+class htmlRenderer {
+   public:
+    htmlRenderer();
+    void clear();
+    void line(std::string_view nick, std::string_view text, bool own);
+    const std::string &html();
+    memoryUsage usage();
+
+   private:
+    struct style {
+        bool bold = false, italic = false, underline = false;
+        int fg = -1, bg = -1;  // -1 is the default colour
+        bool operator==(const style &o) const;
+    };
+    std::string out;  // kept between batches, only its length is reset
+
+    void format(std::string_view text);
+    void openSpan(const style &s);
+    void escape(std::string_view text);
+    static size_t linkLength(std::string_view text, size_t at);
+};
+#endif
@@ -0,0 +1,41 @@
+#ifndef INGEST_SCHEDULER
+#define INGEST_SCHEDULER
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memoryUsage.hpp"
+
+// Time-sliced processing of received lines.
+// Lines are copied into a backlog on arrival and handled in slices that stop once the per-slice budget is spent,
+// chunk sizes follow the measured cost per line so the clock is read a handful of times per slice
+class ingestScheduler {
+   public:
+    ingestScheduler();
+    void setBudget(uint64_t ns);
+    bool enabled();
+    void push(std::string_view line);
+    bool pending();
+    size_t queued();
+    size_t run(const std::function<void(std::string_view)> &handle, bool drain = false);
+    void setMemoryBudget(size_t bytes);
+    bool overBudget();
+    memoryUsage usage();
+    std::string statsJson();
+
+   private:
+    uint64_t budget;      // ns per slice, 0 handles lines as they arrive
+    std::string backlog;  // received lines back to back
+    std::vector<uint32_t> ends;
+    size_t next;        // index of the first unhandled line
+    double cost;        // moving average of ns per line
+    uint64_t slices, lines, lastSlice, maxSlice;
+    memoryUsage stats;
+
+    std::string_view line(size_t i);
+    void compact();
+};
+#endif
@@ -0,0 +1,54 @@
+#ifndef INTERN_POOL
+#define INTERN_POOL
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "memoryUsage.hpp"
+#include "snapshot.hpp"
+
+// Connection scoped string pool for nicks and channel names.
+// Every distinct name (under the casemapping) is stored once in an arena and known by a 32-bit id,
+// state holding names holds ids instead so comparing two names is comparing two integers.
+// Ids are reference counted and reused once the last holder releases them
+class internPool {
+   public:
+    internPool();
+    void setCasemapping(const unsigned char *table);
+    uint32_t intern(std::string_view name);
+    uint32_t find(std::string_view name) const;
+    void retain(uint32_t id);
+    void release(uint32_t id);
+    void respell(uint32_t id, std::string_view name);
+    std::string_view view(uint32_t id) const;
+    std::string name(uint32_t id) const;
+    bool equal(std::string_view a, std::string_view b) const;
+    int compare(std::string_view a, std::string_view b) const;
+    void clear();
+    void save(snapshot &s, const std::unordered_map<uint32_t, uint32_t> &unsaved) const;
+    bool restore(snapshot &s);
+    memoryUsage usage();
+
+   private:
+    struct entry {
+        uint32_t offset, length, refs, hash;
+    };
+
+    const unsigned char *fold;  // 256 entry casefold table
+    std::string arena;
+    std::vector<entry> entries;   // id - 1
+    std::vector<uint32_t> slots;  // open addressing, id, 0 is empty
+    std::vector<uint32_t> freeIds;
+    size_t live, dead;  // arena bytes of live and released names
+
+    uint32_t hash(std::string_view name) const;
+    void place(uint32_t id);
+    void unplace(uint32_t id);
+    void grow();
+    void compact();
+    void write(snapshot &s) const;
+};
+#endif
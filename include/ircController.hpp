@@ -1,25 +1,98 @@
 #ifndef IRC_CONTROLLER
 #define IRC_CONTROLLER
 
+#ifdef __EMSCRIPTEN__
+#ifndef IRC_CAPI
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
+#endif
 #include <emscripten/websocket.h>
+#endif
 
-#include <iostream>
+#include <cstdint>
+#include <functional>
 #include <list>
 #include <map>
+#include <unordered_map>
 
+#include "argList.hpp"
+#include "backoff.hpp"
+#include "capture.hpp"
+#include "channelDirectory.hpp"
+#include "charset.hpp"
+#include "eventBuffer.hpp"
+#include "framer.hpp"
+#include "htmlRenderer.hpp"
+#include "ingestScheduler.hpp"
+#include "internPool.hpp"
+#include "isupport.hpp"
+#include "lagMeter.hpp"
+#include "memoryUsage.hpp"
 #include "message.hpp"
+#include "messageLog.hpp"
+#include "messageQueue.hpp"
+#include "outboundQueue.hpp"
+#include "presenceCache.hpp"
+#include "registration.hpp"
+#include "requestTracker.hpp"
+#include "roster.hpp"
+#include "snapshot.hpp"
+#include "targetRouter.hpp"
+#include "timerWheel.hpp"
 
 class ircController {
    private:
-    std::vector<message> messages, infoMessages;
-    std::vector<std::string> channels;
-    bool debug, categorize;
+    internPool pool;  // declared first, roster and conversations hold ids into it
+    messageQueue messages, infoMessages;
+    targetRouter conversations;
+    roster members;
+    eventBuffer events;
+    presenceCache presence;
+    std::vector<uint32_t> channels;
+    std::unordered_map<uint32_t, std::string> channelKeys;  // by channel id, keys we joined with
+    memoryUsage channelStats, parserStats;
+    registration session;
+    isupport settings;
+    const unsigned char *foldTable;  // casemapping the name tables were last built with
+    requestTracker requests;
+    channelDirectory directory;
+    std::string argBuffer;
+    charset decoder;
+    framer frames;
+    std::vector<std::string_view> lines;
+    ingestScheduler scheduler;
+    capture recorder;
+    messageLog log;
+    htmlRenderer html;
+    outboundQueue outbound;
+    lagMeter lag;
+    timerWheel timers;
+    uint64_t lagTimer, drainTimer, autosaveTimer, reconnectTimer, presenceTimer;  // wheel ids, 0 while off
+    backoff retry;
+    std::vector<std::string> replay;  // held or queued when the socket was lost, sent again once registered
+    uint64_t lastSeen;                // unix ms of the last frame received before the loss
+    std::vector<std::string> historyBatches;  // open chathistory batch references
+    bool reconnecting, quitting;
+    uint64_t revision, savedRevision;  // bumped on every change a snapshot would see
+    std::string autosavePath;
+    bool resumed;  // state restored from a snapshot, kept when the socket connects
+    bool debug, categorize, profiling;
 
    public:
     static int websocket;
     static std::string server;
+    long hostTimer;   // browser timeout driving the wheel, 0 if none is set
+    uint64_t hostAt;  // ms, when it fires
+
+    // accumulated nanoseconds per ingest stage, filled while profiling is on
+    struct stageTimes {
+        uint64_t framing, decoding, parsing, dispatching, lines;
+    } stages;
+
+    // native builds have no websocket, outgoing lines are handed here instead
+    std::function<void(const std::string &)> sink;
+    // opens a new socket to the same server, set by openWebSocket
+    std::function<void()> reopen;
 
    public:
     // exported
@@ -29,12 +102,51 @@ class ircController {
     int getWebsocketConnection();
     // config
     void setDebug(bool _debug);
+    bool setCharset(std::string name);
+    void setProfiling(bool _profiling);
+    bool startCapture(std::string path);
+    void stopCapture();
+    std::string getMemoryUsage();
+    bool setMemoryBudget(std::string subsystem, double bytes);
+    void setCapabilities(std::vector<std::string> caps);
+    void setIngestBudget(double ms);
+    std::string getSchedulerStats();
+    void setPacing(double linesPerSecond, int burst);
+    void setLagInterval(double seconds);
+    std::string getLagStats();
+    bool saveSnapshot(std::string path);
+    bool restoreSnapshot(std::string path);
+    void setAutosave(std::string path, double seconds);
+    void setReconnect(double initialSeconds, double maxSeconds);
+    void setPresenceRefresh(double staleSeconds, double intervalSeconds);
+    bool openLog(std::string dir);
+    void closeLog();
+    std::string getHistory(std::string target, double cursor, int count);
+    double seekHistory(std::string target, double time);
+    std::string getConnectionState();
+    std::string getServerSettings();
+    std::string getNick();
+    void setEventBuffer(int events, int textBytes);
+    std::string getEventLayout();
+    std::string getEventCommands();
+    std::string getEventName(int id);
     // general
     void registerUser(std::string username, std::string hostname, std::string servername, std::string realname, std::string nick);
     std::string getNextMessage();
+    bool subscribe(std::string target);
+    bool unsubscribe(std::string target);
+    std::string getTargetMessages(std::string target, int max);
+    std::string renderTargetMessages(std::string target, int max);
+    std::string renderOwnMessage(std::string text);
+    std::string getUnreadCounts();
     std::string getNextInfoMessage();
+    std::string getNextReply();
+    std::string getListPage(std::string filter, std::string sort, int offset, int count);
     void sendMessage(std::string msg);
     std::vector<std::string> getChannels();
+    std::string getMembers(std::string channel);
+    std::string completeNick(std::string channel, std::string prefix, int limit);
+    std::string getPresence(std::string nick);
 
     // actual IRC commands
     void away(std::string away_msg);
@@ -53,13 +165,15 @@ class ircController {
     void privmsg(std::string text);
     void quit(std::string message);
     bool part(std::vector<std::string> chans, std::string reason = "");
-    bool list(std::string patterns);
+    int list(std::string patterns);
     bool loadmodule(std::string module);
-    void lusers();
+    int lusers();
     bool mode(std::string target, std::string modes, std::vector<std::string> params);
+    bool monitor(std::vector<std::string> nicks);
+    bool unmonitor(std::vector<std::string> nicks);
     void modules();
-    void motd(std::string server);
-    void names(std::vector<std::string> chans);
+    int motd(std::string server);
+    int names(std::vector<std::string> chans);
     bool nick(std::string nickname);
     bool notice(std::vector<std::string> targets, std::string message);
     bool oper(std::string name, std::string pass);
@@ -71,7 +185,7 @@ class ircController {
     bool restart(std::string server);
     bool servlist(std::string nick, std::string operType);
     bool squery(std::string target, std::string message);
-    bool stats(std::string character, std::string server);
+    int stats(std::string character, std::string server);
     bool time(std::string server);
     bool topic(std::string channel, std::string newTopic);
     bool unloadmodule(std::string module);
@@ -79,21 +193,72 @@ class ircController {
     bool userhost(std::vector<std::string> nicks);
     bool version(std::string server);
     bool wallops(std::string message);
-    bool who(std::string pattern_s, std::string flags, std::string fields, std::string queryType, std::string pattern_e);
-    bool whois(std::string server, std::vector<std::string> nicks);
+    int who(std::string pattern_s, std::string flags, std::string fields, std::string queryType, std::string pattern_e);
+    int whois(std::string server, std::vector<std::string> nicks);
     bool whowas(std::string nick, std::string count);
     bool zline(std::vector<std::string> ipaddr, std::string duration, std::string reason);
+    // list commands with the list passed as one delimited string or through the shared arg buffer
+    int bulk(std::string command, std::string list, std::string arg1, std::string arg2);
+    int bulkView(std::string command, int len, std::string arg1, std::string arg2);
+    char *reserveArgs(size_t size);
+    void receive(std::string frame);
+#if defined(__EMSCRIPTEN__) && !defined(IRC_CAPI)
+    emscripten::val getArgBuffer(int size);
+    emscripten::val getEventViews();
+#endif
     // void commands();
 
     // not exported
-    void categorizeMsg(std::string msg);
+    void socketConnecting();
+    void socketOpened();
+    void socketClosed();
+    void ingest(const char *data, size_t len);
+    size_t runSlice();
+    size_t flushOutbound();
+    size_t runTimers();
+    void sendLagPing();
+    void refreshPresence();
+    bool autosave();
+    void categorizeMsg(std::string_view msg);
+    size_t forget();
 
    private:
+    void armTimers();
+    uint32_t track(requestTracker::kind type, std::vector<std::string> keys = {});
+    void expireRequest(uint32_t id);
+    void fetchMissed();
+    void replayed(message &m);
+    int runBulk(std::string_view command, std::string_view list, std::string arg1, std::string arg2);
+    bool xline(const char *command, const argList &masks, std::string duration, std::string reason);
+    bool isonList(const argList &nicks);
+    bool joinList(const argList &chans, const argList &keys);
+    bool kickList(std::string chan, const argList &nicks, std::string reason);
+    bool killList(const argList &nicks, std::string reason);
+    bool modeList(std::string target, std::string modes, const argList &params);
+    bool monitorList(const argList &nicks, bool add);
+    void sendLines(const std::vector<std::string> &lines);
+    int namesList(const argList &chans);
+    bool noticeList(const argList &targets, std::string message);
+    bool partList(const argList &chans, std::string reason);
+    bool userhostList(const argList &nicks);
+    int whoisList(std::string server, const argList &nicks);
+    void dispatch(message &m);
+    void applySettings();
+    size_t lineRoom();
+    size_t echoOverhead();
+    void logSent(std::string_view command, const argList &targets, const argList &pieces);
+    bool sendTargeted(std::string_view command, std::string_view leading, const argList &targets, std::string_view text, bool split);
+    bool control(std::string_view line);
+    void send(const std::string &frame, bool priority);
+    void sendFrame(const std::string &frame);
+    size_t parserBytes();
     void pong(std::string server);
 };
 
 #endif  // ircController
 
+#if defined(__EMSCRIPTEN__) && !defined(IRC_CAPI)
+
 // Translates JS arrays into std::vectors and vice versa
 namespace emscripten {
 namespace internal {
@@ -122,4 +287,5 @@ struct TypeID<T,
 };
 
 }  // namespace internal
-}  // namespace emscripten
\ No newline at end of file
+}  // namespace emscripten
+#endif
@@ -0,0 +1,43 @@
+#ifndef ISUPPORT
+#define ISUPPORT
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "message.hpp"
+#include "snapshot.hpp"
+
+// Settings the server advertises in RPL_ISUPPORT (005), parsed into typed fields.
+// Defaults are the RFC 1459/2812 values used until a 005 says otherwise
+class isupport {
+   public:
+    enum casemapping { ASCII,
+                       RFC1459,
+                       STRICT_RFC1459 };
+
+    isupport();
+    bool offer(message &m);
+    void reset();
+    const unsigned char *foldTable() const;
+    static const unsigned char *foldTable(casemapping mapping);
+    size_t maxTargets(std::string_view command) const;
+    bool isChannel(std::string_view name) const;
+    std::string asJson() const;
+    void save(snapshot &s) const;
+    bool restore(snapshot &s);
+
+    casemapping mapping;
+    std::string chantypes;
+    std::string prefixModes, prefixSymbols;  // highest first, "ov" and "@+"
+    size_t maxTargetsDefault;                // MAXTARGETS, 0 for unlimited
+    std::map<std::string, size_t> targmax;   // TARGMAX per command, 0 for unlimited
+    size_t lineLen, nickLen, channelLen, topicLen;
+    std::string network;
+    std::map<std::string, std::string> tokens;  // every token as received
+
+   private:
+    void apply(const std::string &key, const std::string &value, bool negated);
+};
+#endif
@@ -0,0 +1,30 @@
+#ifndef LAG_METER
+#define LAG_METER
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+// Round trip time to the server, measured with client initiated PINGs.
+// Every PING carries a cookie, the matching PONG is timed when it arrives, before any ingest backlog
+class lagMeter {
+   public:
+    lagMeter();
+    std::string ping(uint64_t nowMs);
+    bool pong(std::string_view cookie, uint64_t nowMs);
+    void reset();
+    double current(uint64_t nowMs);
+    std::string statsJson(uint64_t nowMs, size_t outbound, size_t ingest);
+
+   private:
+    struct probe {
+        uint32_t id;
+        uint64_t sent;  // ms
+    };
+    std::deque<probe> pending;  // oldest first
+    uint32_t counter;
+    double last, average, max;  // ms
+    uint64_t samples, lost;
+};
+#endif
@@ -1,4 +1,6 @@
+#ifndef IRC_CAPI
 #include <emscripten/bind.h>
+#endif
 #include <emscripten/emscripten.h>
 #include <emscripten/websocket.h>
 #include <stdio.h>
@@ -6,3 +8,5 @@
 #include <unistd.h>
 
 #include "ircController.hpp"
+
+void openWebSocket(std::string url, std::string port);
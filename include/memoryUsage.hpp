@@ -0,0 +1,42 @@
+#ifndef MEMORY_USAGE
+#define MEMORY_USAGE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../json/json11.hpp"
+
+// live accounting for one container, budget 0 means unbounded
+struct memoryUsage {
+    size_t bytes = 0, count = 0, budget = 0;
+    uint64_t evicted = 0;
+
+    json11::Json asJson() const {
+        return json11::Json::object{
+            {"bytes", (double)bytes},
+            {"count", (double)count},
+            {"budget", (double)budget},
+            {"evicted", (double)evicted}};
+    }
+};
+
+// heap bytes owned by a string, zero while it fits the small string buffer
+inline size_t heapBytes(const std::string &s) {
+    const char *p = s.data();
+    if (p >= (const char *)&s && p < (const char *)(&s + 1)) return 0;
+    return s.capacity() + 1;
+}
+
+template <typename T>
+inline size_t heapBytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T);
+}
+
+inline size_t heapBytes(const std::vector<std::string> &v) {
+    size_t bytes = v.capacity() * sizeof(std::string);
+    for (auto it = v.begin(); it != v.end(); it++) bytes += heapBytes(*it);
+    return bytes;
+}
+#endif
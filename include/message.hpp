@@ -1,7 +1,10 @@
 #ifndef MESSAGE
 #define MESSAGE
 
-#include <iostream>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "../json/json11.hpp"
 
@@ -12,19 +15,22 @@ class message {
     static const char CR = 0xd;
     static const char LF = 0xa;
 
-    message(std::string str, bool debug = false);
-    void parse();
+    message(std::string_view line, bool debug = false);
+    void parse(std::string_view line);
     std::string asJson();
     void print_all();
+    size_t memorySize() const;
+    uint64_t serverTime() const;
+    static uint64_t isoTime(std::string_view value);
 
     std::string msg,
         prefix, server, nick, user, host,
         command, trailing,
         crlf;
+    std::string time, batch;  // time and batch tags, empty if the line has none
     std::vector<std::string> middle;
 
    private:
     bool debug;
-    std::string unparsed_msg;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef MESSAGE_LOG
+#define MESSAGE_LOG
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "isupport.hpp"
+#include "memoryUsage.hpp"
+#include "message.hpp"
+
+// Durable history of every conversation, kept on disk instead of the heap.
+// A directory of numbered segments, each an append-only file of records
+//  <record> ::= <varint length of the rest> <varint unix ms> <varint previous segment, 0 if none> <varint previous offset>
+//               <varint target length> <target> <line>
+// every record links back to the previous one of its target, a page of history is read by following the links.
+// A sidecar <segment>.idx keeps a sparse index, one point every 32 records of a target, and once the segment is
+// sealed, the last record of every target in it
+//  <point>  ::= <u8 kind, 0 sparse 1 last> <varint unix ms> <varint offset> <varint target length> <target>
+// Appends are buffered and written once per ingest tick, segments are mmap'd for reading
+class messageLog {
+   public:
+    messageLog();
+    ~messageLog();
+    bool open(std::string dir);
+    void close();
+    bool isOpen();
+    void setCasemapping(const unsigned char *table);
+    void append(std::string_view target, std::string_view line, uint64_t time = 0);
+    void flush();
+    std::string page(std::string_view target, uint64_t cursor, size_t count);
+    uint64_t seek(std::string_view target, uint64_t time);
+    memoryUsage usage();
+    static std::string_view targetOf(const message &m, const isupport &settings, std::string_view ownNick);
+
+   private:
+    struct point {
+        uint64_t time, position;  // position is segment << 32 | offset
+    };
+    struct history {
+        std::vector<point> points;  // sparse, oldest first
+        uint64_t last = 0;          // position of the newest record, 0 if none
+        uint32_t count = 0;         // records appended since open
+    };
+    struct record {
+        uint64_t time, prev;
+        std::string_view target, line;
+    };
+    struct mapping {
+        void *addr;
+        size_t length;
+    };
+
+    std::string dir;
+    uint32_t segment;  // active segment, 0 while closed
+    FILE *data, *index;
+    uint64_t size;                 // bytes of the active segment, the unwritten batch included
+    std::string batch, indexBatch;  // written on flush
+    std::unordered_map<std::string, history> targets;  // keyed by casefolded name
+    std::map<uint32_t, mapping> mapped;
+    const unsigned char *fold;
+
+    std::string key(std::string_view target);
+    std::string path(uint32_t segment, const char *extension);
+    bool openSegment(uint32_t number);
+    void seal();
+    void loadIndex(uint32_t number);
+    bool scan(uint32_t number);
+    std::string_view bytes(uint32_t number);
+    void unmap(uint32_t number);
+    bool read(uint64_t position, record &out);
+};
+#endif
@@ -0,0 +1,27 @@
+#ifndef MESSAGE_QUEUE
+#define MESSAGE_QUEUE
+
+#include <deque>
+
+#include "memoryUsage.hpp"
+#include "message.hpp"
+#include "snapshot.hpp"
+
+// FIFO of parsed messages that keeps a running byte count and drops the oldest entries past its budget
+class messageQueue {
+   public:
+    void push(message &&m);
+    message &front();
+    void pop();
+    bool empty();
+    size_t size();
+    void setBudget(size_t bytes);
+    void save(snapshot &s, size_t tail);
+    bool restore(snapshot &s);
+    memoryUsage usage();
+
+   private:
+    std::deque<message> items;
+    memoryUsage stats;
+};
+#endif
@@ -0,0 +1,35 @@
+#ifndef OUTBOUND_QUEUE
+#define OUTBOUND_QUEUE
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "memoryUsage.hpp"
+
+// Lines on their way to the server.
+// Bulk lines are paced with a token bucket so flood protection never kicks in, control lines (PONG, lag PINGs,
+// QUIT) take the priority lane that is never held back by pacing. Whatever may go is written as one frame
+class outboundQueue {
+   public:
+    outboundQueue();
+    void setPacing(double linesPerSecond, size_t burst);
+    void push(const std::string &frame, bool priority);
+    bool next(std::string &frame, uint64_t nowMs);
+    uint64_t wait(uint64_t nowMs);
+    size_t queued();
+    void clear();
+    void takeBulk(std::vector<std::string> &out);
+    memoryUsage usage();
+
+   private:
+    std::deque<std::string> priority, bulk;  // one line per entry
+    double rate, tokens;                     // rate 0 disables pacing
+    size_t burst;
+    uint64_t refilled;  // ms
+
+    void refill(uint64_t nowMs);
+    static void split(const std::string &frame, std::deque<std::string> &lane);
+};
+#endif
@@ -0,0 +1,77 @@
+#ifndef PRESENCE_CACHE
+#define PRESENCE_CACHE
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "argList.hpp"
+#include "internPool.hpp"
+#include "isupport.hpp"
+#include "memoryUsage.hpp"
+#include "message.hpp"
+#include "roster.hpp"
+
+// What we know about other users: user, host, account, realname, away state, whether they are online and when
+// they were last seen. Filled passively from prefixes, extended JOIN, AWAY, ACCOUNT, CHGHOST, SETNAME, WHOIS and
+// WHO replies, actively from WHOX lines sent for entries the UI asked about once they are stale, grouped into one
+// WHO per channel when enough of a channel is stale. Watched nicks are followed with MONITOR when offered.
+// Only users sharing a channel with us, looked up or watched get an entry, one that is neither looked up nor watched
+// is dropped when the user quits or no longer shares a channel.
+// Entries are keyed by intern pool id and hold a reference on it, hosts are interned too since most users of a
+// network share a few cloaks
+class presenceCache {
+   public:
+    enum state { UNKNOWN,
+                 NO,
+                 YES };
+
+    presenceCache(internPool &pool);
+    bool offer(message &m, uint64_t nowMs, roster &members, const std::string &ownNick);
+    std::string lookup(std::string_view nick, uint64_t nowMs, const isupport &settings);
+    void setStaleAfter(uint64_t ms);
+    void refresh(uint64_t nowMs, roster &members, const isupport &settings, size_t maxLines, std::vector<std::string> &out);
+    void watch(const argList &nicks, bool add, bool registered, const isupport &settings, size_t room, std::vector<std::string> &out);
+    void resync(const isupport &settings, size_t room, std::vector<std::string> &out);
+    void closed();
+    void clear();
+    void setBudget(size_t bytes);
+    void refs(std::unordered_map<uint32_t, uint32_t> &held) const;
+    memoryUsage usage();
+
+   private:
+    struct entry {
+        std::string user, account, realname, awayMessage;  // account "*" when logged out, empty if unknown
+        uint32_t host = 0;                                   // intern pool id, 0 if unknown
+        uint64_t seen = 0, refreshed = 0, asked = 0;             // unix ms, last activity, last WHOX reply, last WHOX sent
+        state away = UNKNOWN, online = UNKNOWN;
+        bool wanted = false;     // looked up while stale, refreshed on the next round
+        bool watched = false;    // followed with MONITOR or refreshed every round
+        bool monitored = false;  // on the server's MONITOR list
+    };
+
+    internPool &pool;
+    std::unordered_map<uint32_t, entry> entries;
+    std::deque<std::string> whoMasks;  // WHOX lines in flight, their 315 is ours
+    size_t monitoring;                 // entries on the server's MONITOR list
+    uint64_t staleMs;
+    memoryUsage stats;
+
+    entry *find(std::string_view nick);
+    entry *admit(std::string_view nick, roster &members);
+    entry *touch(std::string_view nick);
+    void set(std::string &field, std::string_view value);
+    void setHost(entry &e, std::string_view host);
+    void rename(std::string_view from, std::string_view to);
+    void erase(std::unordered_map<uint32_t, entry>::iterator it);
+    void left(std::string_view nick, roster &members);
+    void sweep(roster &members);
+    bool due(const entry &e, uint64_t nowMs);
+    void evict();
+    static size_t monitorLimit(const isupport &settings);
+    static void pack(std::vector<std::string> &out, const char *command, const argList &items, size_t room);
+};
+#endif
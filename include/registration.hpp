@@ -0,0 +1,55 @@
+#ifndef REGISTRATION
+#define REGISTRATION
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "message.hpp"
+
+// Connection state from socket creation up to 001.
+// The registration burst goes out as soon as the socket opens, everything else asked for
+// before 001 is held and flushed as one frame once the server welcomes us
+class registration {
+   public:
+    enum state { DISCONNECTED,
+                 CONNECTING,
+                 OPEN,
+                 REGISTERING,
+                 REGISTERED };
+
+    registration();
+    void identify(std::string username, std::string hostname, std::string servername, std::string realname, std::string nick);
+    void setPassword(std::string pass);
+    void setCapabilities(std::vector<std::string> caps);
+    void setImplied(std::vector<std::string> caps);
+    bool identified();
+    bool enabled(std::string_view cap) const;
+
+    void connecting();
+    std::string opened();
+    std::string start();
+    void closed();
+
+    bool holds(std::string_view line);
+    void hold(std::string line);
+    void takeHeld(std::vector<std::string> &out);
+    std::string offer(message &m);
+    const char *stateName();
+
+    state current;
+    std::string nick;        // nick we are registering or registered with
+    std::string user, host;  // as the server shows them to others, empty until seen
+
+   private:
+    std::string username, hostname, servername, realname, base, password;
+    std::vector<std::string> wanted, implied, offered, acked;  // implied ones come with client features
+    std::vector<std::string> held;
+    int attempts;
+    bool negotiating;
+
+    std::string alternativeNick();
+    std::string endCaps();
+    std::string flush();
+};
+#endif
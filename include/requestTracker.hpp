@@ -0,0 +1,57 @@
+#ifndef REQUEST_TRACKER
+#define REQUEST_TRACKER
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "memoryUsage.hpp"
+#include "message.hpp"
+
+// Ties numeric reply bursts back to the command that asked for them.
+// Replies are collected per request until its end numeric arrives and then delivered as one json result
+class requestTracker {
+   public:
+    enum kind { WHOIS,
+                NAMES,
+                WHO,
+                MOTD,
+                LIST,
+                STATS,
+                LUSERS };
+
+    requestTracker();
+    uint32_t open(kind type, std::vector<std::string> keys, uint64_t nowMs);
+    bool offer(message &m, uint64_t nowMs);
+    uint64_t expire(uint32_t id, uint64_t nowMs, uint64_t idleMs);
+    void failAll(std::string reason);
+    bool hasResult();
+    std::string nextResult();
+    void setBudget(size_t bytes);
+    memoryUsage usage();
+
+   private:
+    struct pending {
+        uint32_t id;
+        kind type;
+        std::vector<std::string> keys;  // nicks or channels the request is about, lowercased
+        size_t remaining;               // end numerics still expected
+        std::vector<message> replies;
+        size_t bytes, rows;  // LIST rows are only counted, they are kept by channelDirectory
+        std::string error;
+        bool delivered;  // truncated result already out, remaining replies are dropped
+        uint64_t active;  // ms, opened or last reply
+    };
+
+    std::deque<pending> requests;
+    std::deque<std::string> results;
+    uint32_t nextId;
+    memoryUsage stats;
+
+    static int role(kind type, int numeric);
+    static std::string keyOf(kind type, int numeric, message &m);
+    void complete(size_t index, bool truncated);
+    json11::Json aggregate(pending &p);
+};
+#endif
@@ -0,0 +1,60 @@
+#ifndef ROSTER
+#define ROSTER
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "internPool.hpp"
+#include "memoryUsage.hpp"
+#include "message.hpp"
+#include "snapshot.hpp"
+
+// Members of the channels we are in, kept up to date from JOIN, PART, KICK, QUIT, NICK and NAMES (353/366).
+// Channels and nicks are intern pool ids, each membership holds a reference on its nick
+// so a nick is reclaimed once it shares no channel with us anymore.
+// Each channel also keeps its members sorted by casefolded nick for completion, ranked by who spoke last
+class roster {
+   public:
+    roster(internPool &pool);
+    void offer(message &m, const std::string &ownNick);
+    bool has(std::string_view channel);
+    void channelsOf(uint32_t nick, std::vector<uint32_t> &out);
+    bool shares(uint32_t nick);
+    size_t count(uint32_t channel);
+    std::string members(std::string channel);
+    std::string complete(std::string_view channel, std::string_view prefix, size_t limit);
+    void setPrefixes(std::string symbols);
+    void reindex();
+    void clear();
+    void save(snapshot &s);
+    bool restore(snapshot &s);
+    memoryUsage usage();
+
+   private:
+    struct member {
+        uint8_t modes;    // bit i set for prefixes[i]
+        uint32_t active;  // activity sequence of the last JOIN or message, 0 if none seen
+    };
+    struct channel {
+        std::unordered_map<uint32_t, member> members;  // nick id
+        std::vector<uint32_t> index;                   // nick ids sorted by casefolded nick
+        bool syncing = false;                          // inside a NAMES burst
+        bool stale = true;                             // index rebuilt on the next completion
+    };
+
+    internPool &pool;
+    std::unordered_map<uint32_t, channel> channels;
+    std::string prefixes;  // membership prefixes, highest first
+    uint32_t activity;     // bumped on every JOIN and message
+
+    channel *find(std::string_view name);
+    void add(channel &c, std::string_view nick, member state);
+    void remove(channel &c, uint32_t nick);
+    void touch(std::string_view channel, std::string_view nick);
+    void sort(channel &c);
+    std::vector<uint32_t>::iterator position(channel &c, std::string_view nick);
+    void drop(uint32_t id);
+};
+#endif
@@ -0,0 +1,37 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Binary image of client state, written while connected and read back on page reload before the socket opens.
+//  <file>  ::= <magic "IRCSNP01"> <u32 0x01020304 in host byte order> <varint body length> <body>
+//  <body>  ::= <settings> <pool> <channels> <roster> <targets> <messages> <infoMessages>
+// varints are unsigned LEB128, strings are a varint length then the bytes.
+// Fixed size tables (intern pool entries and slots) are stored as raw arrays in host byte order and loaded with one
+// copy, a file whose order mark reads differently came from another byte order and is ignored. A new layout bumps the
+// version in the magic so older snapshots are ignored rather than misread
+class snapshot {
+   public:
+    snapshot();
+    void clear();
+    bool save(std::string path);
+    bool load(std::string path);
+    bool ok();
+    size_t size();
+
+    void putVarint(uint64_t value);
+    void putString(std::string_view value);
+    void putBlob(const void *data, size_t bytes);
+
+    uint64_t getVarint();
+    std::string getString();
+    bool getBlob(void *data, size_t bytes);
+
+   private:
+    std::string body;
+    size_t read;  // offset of the next unread byte
+    bool failed;  // a read ran past the end
+};
+#endif
@@ -0,0 +1,51 @@
+#ifndef TARGET_ROUTER
+#define TARGET_ROUTER
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "htmlRenderer.hpp"
+#include "internPool.hpp"
+#include "memoryUsage.hpp"
+#include "message.hpp"
+#include "messageQueue.hpp"
+#include "snapshot.hpp"
+
+// Routes PRIVMSGs by conversation, a channel or the nick of a private query.
+// Only subscribed targets (the ones on screen) keep their messages, every other target
+// just counts unread messages and mentions of our nick
+class targetRouter {
+   public:
+    targetRouter(internPool &pool);
+    bool route(message &&m, const std::string &ownNick);
+    bool subscribe(std::string target);
+    bool unsubscribe(std::string target);
+    bool active();
+    void setChannelTypes(std::string types);
+    std::string next(std::string target, size_t max);
+    size_t render(std::string target, size_t max, const std::string &ownNick, htmlRenderer &out);
+    std::string unreadCounts();
+    void setBudget(size_t bytes);
+    void clear();
+    void save(snapshot &s, size_t tail);
+    bool restore(snapshot &s);
+    memoryUsage usage();
+
+   private:
+    struct target {
+        messageQueue queue;
+        uint32_t unread = 0, mentions = 0;
+        bool subscribed = false;
+    };
+
+    internPool &pool;
+    std::unordered_map<uint32_t, target> targets;  // keyed by name id, each target holds a reference
+    size_t subscribed = 0, budget = 0;
+    std::string chantypes = "#&";
+
+    target &get(std::string_view name);
+    static bool mentions(std::string_view text, const std::string &nick);
+};
+#endif
@@ -0,0 +1,57 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "memoryUsage.hpp"
+
+// Every time based piece of client work, pacing, lag PINGs, autosave, reconnects, expiries.
+// A hierarchical timing wheel, 4 levels of 64 slots, ticks of a few ms: level 0 holds what is due within 64 ticks,
+// each level above 64 times more, timers move down a level when their slot comes up. Timers live in a slab and are
+// linked into their slot, scheduling and cancelling are O(1) and pending timers cost nothing until their slot is reached.
+// The host drives it with a single timer set for nextDue, or natively from a monotonic clock
+class timerWheel {
+   public:
+    timerWheel(uint64_t resolutionMs = 10);
+    uint64_t after(uint64_t nowMs, uint64_t delayMs, std::function<void()> callback);
+    uint64_t every(uint64_t nowMs, uint64_t periodMs, std::function<void()> callback);
+    bool cancel(uint64_t id);
+    bool pending(uint64_t id);
+    size_t advance(uint64_t nowMs);
+    uint64_t nextDue();
+    size_t size();
+    void clear();
+    memoryUsage usage();
+
+   private:
+    static const int levels = 4, slotBits = 6, slots = 1 << slotBits;
+    struct timer {
+        std::function<void()> callback;
+        uint64_t due, period;  // ticks, period 0 for a one shot
+        uint32_t prev, next;   // links in the slot, node index + 1, 0 ends the list
+        uint32_t generation;
+        int16_t slot;          // level * slots + slot, -1 while not linked
+        bool live;
+    };
+    std::vector<timer> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::vector<uint64_t> firing;  // ids taken out of the slot being run
+    uint32_t heads[levels * slots];
+    uint64_t occupied[levels];  // a bit per non empty slot
+    uint64_t resolution;        // ms per tick
+    uint64_t current;           // next tick to run, every earlier one has fired
+    size_t count;
+    bool started;
+
+    uint64_t schedule(uint64_t nowMs, uint64_t delayMs, uint64_t periodMs, std::function<void()> &&callback);
+    void start(uint64_t nowMs);
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(int level);
+    size_t fire();
+    uint64_t nextTick();
+};
+#endif
@@ -0,0 +1,53 @@
+#ifndef VARINT
+#define VARINT
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Unsigned LEB128, the integer encoding of captures, snapshots and the message log:
+// 7 bits a byte, low bits first, the high bit set on every byte but the last. A uint64_t takes at most 10 bytes
+static const size_t varintMax = 10;
+
+// writes value to buf, which has room for varintMax bytes, and returns the bytes written
+inline size_t encodeVarint(uint64_t value, unsigned char *buf) {
+    size_t n = 0;
+    do {
+        buf[n] = value & 0x7F;
+        value >>= 7;
+        if (value) buf[n] |= 0x80;
+        n++;
+    } while (value);
+    return n;
+}
+
+inline void appendVarint(std::string &out, uint64_t value) {
+    unsigned char buf[varintMax];
+    out.append((const char *)buf, encodeVarint(value, buf));
+}
+
+inline size_t varintSize(uint64_t value) {
+    size_t n = 1;
+    while (value >>= 7) n++;
+    return n;
+}
+
+// next() returns the following byte, or a negative value once there is none
+template <typename Next>
+inline bool decodeVarint(Next next, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = next();
+        if (byte < 0) return false;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// reads from in at at, which is moved past the bytes read
+inline bool readVarint(std::string_view in, size_t &at, uint64_t &value) {
+    return decodeVarint([&]() { return at < in.size() ? (int)(unsigned char)in[at++] : -1; }, value);
+}
+#endif
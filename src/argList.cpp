@@ -0,0 +1,88 @@
+#include "../include/argList.hpp"
+
+/**
+ * @brief views over the elements of a vector, nothing is copied
+ *
+ * @param items
+ * @return argList
+ */
+argList views(const std::vector<std::string> &items) {
+    argList out;
+    out.reserve(items.size());
+    for (auto it = items.begin(); it != items.end(); it++) out.emplace_back(*it);
+    return out;
+}
+
+/**
+ * @brief splits a delimited buffer in place.
+ * Items are separated by any of '\n', ',' or ' ', none of which can appear inside a nick, channel or mask,
+ * empty items are skipped
+ *
+ * @param buffer
+ * @param out cleared and filled with views into buffer
+ */
+void splitArgs(std::string_view buffer, argList &out) {
+    out.clear();
+    size_t start = 0;
+    for (size_t i = 0; i <= buffer.size(); i++) {
+        if (i < buffer.size() && buffer[i] != '\n' && buffer[i] != ',' && buffer[i] != ' ') continue;
+        if (i > start) out.push_back(buffer.substr(start, i - start));
+        start = i + 1;
+    }
+}
+
+/**
+ * @brief appends items separated by sep
+ *
+ * @param msg
+ * @param items
+ * @param sep
+ */
+void appendJoined(std::string &msg, const argList &items, char sep) {
+    for (auto it = items.begin(); it != items.end(); it++) {
+        if (it != items.begin()) msg += sep;
+        msg.append(it->data(), it->size());
+    }
+}
+
+/**
+ * @brief cuts a message text into pieces of at most fit bytes in one forward pass.
+ * Pieces end at the last space that keeps at least half of the piece, otherwise on a UTF-8 character boundary,
+ * the space a piece is cut at is dropped. Line breaks always end a piece so a text can not smuggle in another command
+ *
+ * @param text
+ * @param fit bytes a piece may take, at least 4
+ * @param pieces cleared and filled with views into text, empty pieces are skipped
+ */
+void splitText(std::string_view text, size_t fit, argList &pieces) {
+    pieces.clear();
+    if (fit < 4) fit = 4;
+    size_t start = 0, space = std::string_view::npos;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '\r' || c == '\n') {
+            if (i > start) pieces.push_back(text.substr(start, i - start));
+            start = i + 1;
+            space = std::string_view::npos;
+            continue;
+        }
+        if (c == ' ') space = i;
+        if (i - start < fit) continue;
+
+        // text[i] would overflow the piece
+        size_t cut;
+        if (space != std::string_view::npos && space > start && space - start >= fit / 2) {
+            cut = space;
+        } else {
+            // back off continuation bytes 10xxxxxx so a character is never split
+            cut = i;
+            while (cut > start && ((unsigned char)text[cut] & 0xC0) == 0x80 && i - cut < 3) cut--;
+            if (cut == start) cut = i;
+        }
+        pieces.push_back(text.substr(start, cut - start));
+        start = (cut == space) ? cut + 1 : cut;
+        space = std::string_view::npos;
+        if (i < start) i = start - 1;
+    }
+    if (start < text.size()) pieces.push_back(text.substr(start));
+}
@@ -0,0 +1,48 @@
+#include "../include/backoff.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+backoff::backoff() : random((uint32_t)std::chrono::steady_clock::now().time_since_epoch().count()) {
+    initial = 1000;
+    max = 60000;
+    tries = 0;
+}
+
+/**
+ * @brief
+ *
+ * @param initialMs delay before the first attempt, 0 turns reconnecting off
+ * @param maxMs longest delay, never below initialMs
+ */
+void backoff::configure(uint64_t initialMs, uint64_t maxMs) {
+    initial = initialMs;
+    max = std::max(initialMs, maxMs);
+    tries = 0;
+}
+
+bool backoff::enabled() {
+    return initial;
+}
+
+/**
+ * @brief delay before the next attempt, counts the attempt
+ *
+ * @return uint64_t ms, between half and all of min(max, initial * 2^attempts)
+ */
+uint64_t backoff::next() {
+    uint64_t delay = std::min(max, initial << std::min<uint32_t>(tries, 20));
+    tries++;
+    return delay - random() % (delay / 2 + 1);
+}
+
+/**
+ * @brief the connection is back, the next drop starts from the initial delay again
+ */
+void backoff::reset() {
+    tries = 0;
+}
+
+uint32_t backoff::attempts() {
+    return tries;
+}
@@ -0,0 +1,134 @@
+// Plain C exports for the lean build (make lean-capi, -DIRC_CAPI).
+// Takes the place of the embind bindings in main.cpp: no type registry is built at startup and the
+// glue needs no embind runtime, calls go through Module.cwrap/ccall.
+// Strings are returned from one static buffer and stay valid until the next call that returns a string
+#if defined(__EMSCRIPTEN__) && defined(IRC_CAPI)
+
+#include "../include/main.hpp"
+
+static std::string result;
+
+static const char *hand(std::string s) {
+    result = std::move(s);
+    return result.c_str();
+}
+
+extern "C" {
+
+EMSCRIPTEN_KEEPALIVE ircController *irc_create(int debug) {
+    return new ircController(debug);
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_destroy(ircController *c) {
+    delete c;
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_open_websocket(const char *url, const char *port) {
+    openWebSocket(url, port);
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_register(ircController *c, const char *username, const char *hostname, const char *servername,
+                                       const char *realname, const char *nick) {
+    c->registerUser(username, hostname, servername, realname, nick);
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_send(ircController *c, const char *line) {
+    c->sendMessage(line);
+}
+
+// bytes are read in place, len does not count a terminator
+EMSCRIPTEN_KEEPALIVE void irc_receive(ircController *c, const char *data, int len) {
+    if (len > 0) c->ingest(data, len);
+}
+
+// pointer into wasm memory to write a delimited list or a frame into, see irc_bulk and irc_receive
+EMSCRIPTEN_KEEPALIVE char *irc_arg_buffer(ircController *c, int size) {
+    return c->reserveArgs(size < 0 ? 0 : size);
+}
+
+EMSCRIPTEN_KEEPALIVE int irc_bulk(ircController *c, const char *command, int len, const char *arg1, const char *arg2) {
+    return c->bulkView(command, len, arg1, arg2);
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_next_message(ircController *c) {
+    return hand(c->getNextMessage());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_next_info_message(ircController *c) {
+    return hand(c->getNextInfoMessage());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_next_reply(ircController *c) {
+    return hand(c->getNextReply());
+}
+
+EMSCRIPTEN_KEEPALIVE int irc_subscribe(ircController *c, const char *target) {
+    return c->subscribe(target);
+}
+
+EMSCRIPTEN_KEEPALIVE int irc_unsubscribe(ircController *c, const char *target) {
+    return c->unsubscribe(target);
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_target_messages(ircController *c, const char *target, int max) {
+    return hand(c->getTargetMessages(target, max));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_render(ircController *c, const char *target, int max) {
+    return hand(c->renderTargetMessages(target, max));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_render_own(ircController *c, const char *text) {
+    return hand(c->renderOwnMessage(text));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_unread_counts(ircController *c) {
+    return hand(c->getUnreadCounts());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_members(ircController *c, const char *channel) {
+    return hand(c->getMembers(channel));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_presence(ircController *c, const char *nick) {
+    return hand(c->getPresence(nick));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_state(ircController *c) {
+    return hand(c->getConnectionState());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_nick(ircController *c) {
+    return hand(c->getNick());
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_set_pacing(ircController *c, double linesPerSecond, int burst) {
+    c->setPacing(linesPerSecond, burst);
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_set_reconnect(ircController *c, double initialSeconds, double maxSeconds) {
+    c->setReconnect(initialSeconds, maxSeconds);
+}
+
+EMSCRIPTEN_KEEPALIVE void irc_set_event_buffer(ircController *c, int events, int textBytes) {
+    c->setEventBuffer(events, textBytes);
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_event_layout(ircController *c) {
+    return hand(c->getEventLayout());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_event_commands(ircController *c) {
+    return hand(c->getEventCommands());
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_event_name(ircController *c, int id) {
+    return hand(c->getEventName(id));
+}
+
+EMSCRIPTEN_KEEPALIVE const char *irc_memory_usage(ircController *c) {
+    return hand(c->getMemoryUsage());
+}
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "../include/capture.hpp"
+
+#include <chrono>
+
+#include "../include/varint.hpp"
+
+static const char MAGIC[8] = {'I', 'R', 'C', 'C', 'A', 'P', '0', '1'};
+
+static uint64_t steadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+capture::capture() {
+    file = nullptr;
+    begin = last = 0;
+}
+
+capture::~capture() {
+    close();
+}
+
+/**
+ * @brief starts a new capture, truncating path
+ * in the browser the file lives on MEMFS and can be fetched with FS.readFile
+ *
+ * @param path
+ * @return true
+ * @return false if file could not be created
+ */
+bool capture::open(std::string path) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    uint64_t start = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    unsigned char header[8];
+    for (int i = 0; i < 8; i++) header[i] = (unsigned char)(start >> (8 * i));
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), file);
+    std::fwrite(header, 1, sizeof(header), file);
+    begin = last = steadyMicros();
+    return true;
+}
+
+void capture::close() {
+    if (!file) return;
+    std::fclose(file);
+    file = nullptr;
+}
+
+bool capture::isOpen() {
+    return file != nullptr;
+}
+
+/**
+ * @brief appends one raw line to the capture
+ *
+ * @param connection connection the line was received on
+ * @param line
+ */
+void capture::write(uint32_t connection, std::string_view line) {
+    if (!file) return;
+    uint64_t now = steadyMicros();
+    writeVarint(now - last);
+    writeVarint(connection);
+    writeVarint(line.size());
+    std::fwrite(line.data(), 1, line.size(), file);
+    last = now;
+}
+
+void capture::writeVarint(uint64_t value) {
+    unsigned char buf[varintMax];
+    std::fwrite(buf, 1, encodeVarint(value, buf), file);
+}
+
+capture::reader::reader() {
+    file = nullptr;
+    start = time = 0;
+}
+
+capture::reader::~reader() {
+    if (file) std::fclose(file);
+}
+
+/**
+ * @brief opens a capture for reading
+ *
+ * @param path
+ * @return true
+ * @return false if file can not be read or is not a capture
+ */
+bool capture::reader::open(std::string path) {
+    if (file) std::fclose(file);
+    file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char magic[8];
+    unsigned char header[8];
+    if (std::fread(magic, 1, 8, file) != 8 || std::string_view(magic, 8) != std::string_view(MAGIC, 8) ||
+        std::fread(header, 1, 8, file) != 8) {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    start = 0;
+    for (int i = 0; i < 8; i++) start |= (uint64_t)header[i] << (8 * i);
+    time = 0;
+    return true;
+}
+
+/**
+ * @brief reads next record
+ *
+ * @param rec reused between calls so line keeps its capacity
+ * @return true
+ * @return false on end of file or truncated record
+ */
+bool capture::reader::next(record &rec) {
+    uint64_t delta, connection, len;
+    if (!file || !readVarint(delta) || !readVarint(connection) || !readVarint(len)) return false;
+    time += delta;
+    rec.time = time;
+    rec.connection = (uint32_t)connection;
+    rec.line.resize(len);
+    return std::fread(&rec.line[0], 1, len, file) == len;
+}
+
+bool capture::reader::readVarint(uint64_t &value) {
+    // EOF is negative
+    return decodeVarint([this]() { return std::fgetc(file); }, value);
+}
@@ -0,0 +1,304 @@
+#include "../include/channelDirectory.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "../include/isupport.hpp"
+
+static bool equalFolded(const unsigned char *fold, std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (fold[(unsigned char)a[i]] != fold[(unsigned char)b[i]]) return false;
+    }
+    return true;
+}
+
+static int compareFolded(const unsigned char *fold, std::string_view a, std::string_view b) {
+    size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+        unsigned char x = fold[(unsigned char)a[i]], y = fold[(unsigned char)b[i]];
+        if (x != y) return x < y ? -1 : 1;
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+// needle is already folded
+static bool containsFolded(const unsigned char *fold, std::string_view haystack, const std::string &needle) {
+    if (needle.size() > haystack.size()) return false;
+    for (size_t i = 0; i + needle.size() <= haystack.size(); i++) {
+        size_t k = 0;
+        while (k < needle.size() && fold[(unsigned char)haystack[i + k]] == (unsigned char)needle[k]) k++;
+        if (k == needle.size()) return true;
+    }
+    return false;
+}
+
+// '*' matches any run, '?' any single character, pattern is already folded
+static bool globFolded(const unsigned char *fold, std::string_view text, const std::string &pattern) {
+    size_t t = 0, p = 0, star = std::string::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || (unsigned char)pattern[p] == fold[(unsigned char)text[t]])) {
+            t++;
+            p++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = t;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+channelDirectory::channelDirectory() {
+    fold = isupport::foldTable(isupport::RFC1459);
+    complete = false;
+    viewed = 0;
+    dirty = false;
+    deadBytes = 0;
+}
+
+/**
+ * @brief takes LIST numerics
+ *
+ * @param m
+ * @return true if the message was a 322 row and has been stored
+ * @return false otherwise, 321 and 323 are only noted so they can still complete a request
+ */
+bool channelDirectory::offer(message &m) {
+    if (m.command == "321") {
+        complete = false;
+        return false;
+    }
+    if (m.command == "323") {
+        complete = true;
+        return false;
+    }
+    if (m.command != "322") return false;
+    if (m.middle.size() < 3) return true;
+    insert(m.middle[1], (uint32_t)std::strtoul(m.middle[2].c_str(), nullptr, 10), m.trailing);
+    return true;
+}
+
+/**
+ * @brief drops all rows, called when a new LIST is sent
+ */
+void channelDirectory::reset() {
+    arena.clear();
+    deadBytes = 0;
+    entries.clear();
+    slots.clear();
+    complete = false;
+    view.clear();
+    viewed = 0;
+    viewFilter.clear();
+    viewSort.clear();
+}
+
+/**
+ * @brief returns one page of the filtered and sorted directory.
+ * Repeating a query with the same filter and sort only looks at rows received since the last call
+ *
+ * @param filter case insensitive substring of name or topic, or a glob on the name if it has '*' or '?'
+ * @param sort "users" (most first, default) or "name"
+ * @param offset
+ * @param count
+ * @return std::string json {"total", "matched", "complete", "offset", "channels": [{"name", "users", "topic"}]}
+ */
+std::string channelDirectory::getPage(std::string filter, std::string sort, size_t offset, size_t count) {
+    for (auto it = filter.begin(); it != filter.end(); it++) *it = fold[(unsigned char)*it];
+    if (sort != "name") sort = "users";
+    if (filter != viewFilter || sort != viewSort || dirty) {
+        viewFilter = filter;
+        viewSort = sort;
+        view.clear();
+        viewed = 0;
+        dirty = false;
+    }
+
+    if (viewed < entries.size()) {
+        bool glob = filter.find_first_of("*?") != std::string::npos;
+        size_t old = view.size();
+        for (size_t i = viewed; i < entries.size(); i++) {
+            if (filter.empty() || matches(entries[i], filter, glob)) view.push_back((uint32_t)i);
+        }
+        viewed = entries.size();
+        auto less = [this](uint32_t a, uint32_t b) { return before(a, b); };
+        std::sort(view.begin() + old, view.end(), less);
+        std::inplace_merge(view.begin(), view.begin() + old, view.end(), less);
+    }
+
+    json11::Json::array rows;
+    for (size_t i = offset; i < view.size() && i < offset + count; i++) {
+        const entry &e = entries[view[i]];
+        rows.push_back(json11::Json::object{
+            {"name", std::string(nameOf(e))},
+            {"users", (double)e.users},
+            {"topic", std::string(topicOf(e))}});
+    }
+    json11::Json page = json11::Json::object{
+        {"total", (double)entries.size()},
+        {"matched", (double)view.size()},
+        {"complete", complete},
+        {"offset", (double)offset},
+        {"channels", rows}};
+    return page.dump();
+}
+
+/**
+ * @brief switches the casefold table used to dedupe, filter and sort names and rebuilds the index
+ *
+ * @param table 256 entry table, see isupport
+ */
+void channelDirectory::setCasemapping(const unsigned char *table) {
+    fold = table;
+    if (entries.size()) grow();
+    dirty = true;
+}
+
+/**
+ * @brief caps the directory size, rows past it are dropped and counted as evicted
+ *
+ * @param bytes 0 for unbounded
+ */
+void channelDirectory::setBudget(size_t bytes) {
+    stats.budget = bytes;
+}
+
+memoryUsage channelDirectory::usage() {
+    memoryUsage ret = stats;
+    ret.count = entries.size();
+    ret.bytes = arena.capacity() + entries.capacity() * sizeof(entry) + slots.capacity() * sizeof(uint32_t) +
+                view.capacity() * sizeof(uint32_t);
+    return ret;
+}
+
+std::string_view channelDirectory::nameOf(const entry &e) const {
+    return std::string_view(arena.data() + e.name, e.nameLen);
+}
+
+std::string_view channelDirectory::topicOf(const entry &e) const {
+    return std::string_view(arena.data() + e.topic, e.topicLen);
+}
+
+// FNV-1a over the folded name
+uint32_t channelDirectory::hash(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < name.size(); i++) {
+        h ^= fold[(unsigned char)name[i]];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int64_t channelDirectory::find(std::string_view name) {
+    if (slots.empty()) return -1;
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(name) & mask;; i = (i + 1) & mask) {
+        if (!slots[i]) return -1;
+        if (equalFolded(fold, nameOf(entries[slots[i] - 1]), name)) return slots[i] - 1;
+    }
+}
+
+void channelDirectory::insert(std::string_view name, uint32_t users, std::string_view topic) {
+    if (name.size() > 0xFFFF) name = name.substr(0, 0xFFFF);
+    if (topic.size() > 0xFFFF) topic = topic.substr(0, 0xFFFF);
+    int64_t found = find(name);
+    if (found >= 0) {
+        // same channel listed again, keep the newest numbers
+        entry &e = entries[found];
+        if (topicOf(e) != topic) retopic(e, topic);
+        if (e.users != users) dirty = true;
+        e.users = users;
+        return;
+    }
+    if (stats.budget && usage().bytes + name.size() + topic.size() + sizeof(entry) > stats.budget) {
+        stats.evicted++;
+        return;
+    }
+
+    entry e;
+    e.name = (uint32_t)arena.size();
+    e.nameLen = (uint16_t)name.size();
+    arena.append(name.data(), name.size());
+    e.topic = (uint32_t)arena.size();
+    e.topicLen = (uint16_t)topic.size();
+    arena.append(topic.data(), topic.size());
+    e.users = users;
+    entries.push_back(e);
+
+    if (entries.size() * 4 > slots.size() * 3) {
+        grow();
+        return;
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = hash(name) & mask;
+    while (slots[i]) i = (i + 1) & mask;
+    slots[i] = (uint32_t)entries.size();
+}
+
+// replaces the topic of a row listed again, in place when it fits, the old bytes are dead otherwise
+void channelDirectory::retopic(entry &e, std::string_view topic) {
+    dirty = true;
+    if (topic.size() <= e.topicLen) {
+        arena.replace(e.topic, topic.size(), topic.data(), topic.size());
+        deadBytes += e.topicLen - topic.size();
+        e.topicLen = (uint16_t)topic.size();
+        return;
+    }
+    if (stats.budget && usage().bytes + topic.size() > stats.budget) {
+        if (deadBytes) compact();
+        if (usage().bytes + topic.size() > stats.budget) {
+            // keep the old topic rather than go over
+            stats.evicted++;
+            return;
+        }
+    }
+    deadBytes += e.topicLen;
+    e.topic = (uint32_t)arena.size();
+    e.topicLen = (uint16_t)topic.size();
+    arena.append(topic.data(), topic.size());
+    if (deadBytes > 4096 && deadBytes * 2 > arena.size()) compact();
+}
+
+// copies live names and topics into a fresh arena, dropping replaced topics
+void channelDirectory::compact() {
+    std::string packed;
+    packed.reserve(arena.size() - deadBytes);
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        uint32_t name = (uint32_t)packed.size();
+        packed.append(nameOf(*it));
+        uint32_t topic = (uint32_t)packed.size();
+        packed.append(topicOf(*it));
+        it->name = name;
+        it->topic = topic;
+    }
+    arena.swap(packed);
+    deadBytes = 0;
+}
+
+// doubles the slot table and reinserts every entry
+void channelDirectory::grow() {
+    std::vector<uint32_t>(std::max<size_t>(64, slots.size() * 2), 0).swap(slots);
+    size_t mask = slots.size() - 1;
+    for (size_t k = 0; k < entries.size(); k++) {
+        size_t i = hash(nameOf(entries[k])) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = (uint32_t)(k + 1);
+    }
+}
+
+bool channelDirectory::matches(const entry &e, const std::string &filter, bool glob) {
+    if (glob) return globFolded(fold, nameOf(e), filter);
+    return containsFolded(fold, nameOf(e), filter) || containsFolded(fold, topicOf(e), filter);
+}
+
+bool channelDirectory::before(uint32_t a, uint32_t b) {
+    const entry &x = entries[a], &y = entries[b];
+    if (viewSort == "users" && x.users != y.users) return x.users > y.users;
+    return compareFolded(fold, nameOf(x), nameOf(y)) < 0;
+}
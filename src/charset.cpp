@@ -0,0 +1,201 @@
+#include "../include/charset.hpp"
+
+#include <cctype>
+#include <cstring>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Unicode code points for CP1252 0x80-0x9F, unassigned bytes map to their C1 control like browsers do
+static const uint16_t cp1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+
+/**
+ * @brief length of the leading run of ascii bytes.
+ * Checks 16 bytes per step with wasm simd128 (or SSE2 natively), then 8 bytes per step, then bytewise
+ *
+ * @param s
+ * @param len
+ * @return size_t
+ */
+static size_t asciiPrefix(const unsigned char *s, size_t len) {
+    size_t i = 0;
+#if defined(__wasm_simd128__)
+    for (; i + 16 <= len; i += 16) {
+        if (wasm_i8x16_bitmask(wasm_v128_load(s + i))) break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)))) break;
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ULL) break;
+    }
+    while (i < len && s[i] < 0x80) i++;
+    return i;
+}
+
+static void appendCodepoint(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+/**
+ * @brief Construct a new charset object
+ *
+ * @param fallback encoding assumed for lines that are not valid UTF-8
+ */
+charset::charset(legacy fallback) {
+    this->fallback = fallback;
+    transcoded = 0;
+}
+
+/**
+ * @brief true if every byte is 7-bit ascii
+ *
+ * @param data
+ * @param len
+ * @return true
+ * @return false
+ */
+bool charset::isAscii(const char *data, size_t len) {
+    return asciiPrefix((const unsigned char *)data, len) == len;
+}
+
+/**
+ * @brief validates UTF-8 as defined by RFC 3629
+ * rejects overlong forms, surrogates and code points above U+10FFFF.
+ * Ascii runs are skipped with the vectorized scan so only multibyte sequences are decoded
+ *
+ * @param data
+ * @param len
+ * @return true
+ * @return false
+ */
+bool charset::isUtf8(const char *data, size_t len) {
+    const unsigned char *s = (const unsigned char *)data;
+    size_t i = 0;
+    while (true) {
+        i += asciiPrefix(s + i, len - i);
+        if (i == len) return true;
+
+        unsigned char c = s[i], lo = 0x80, hi = 0xBF;
+        size_t follow;
+        if (c >= 0xC2 && c <= 0xDF) {
+            follow = 1;
+        } else if (c == 0xE0) {
+            follow = 2;
+            lo = 0xA0;
+        } else if (c == 0xED) {
+            follow = 2;
+            hi = 0x9F;
+        } else if (c >= 0xE1 && c <= 0xEF) {
+            follow = 2;
+        } else if (c == 0xF0) {
+            follow = 3;
+            lo = 0x90;
+        } else if (c >= 0xF1 && c <= 0xF3) {
+            follow = 3;
+        } else if (c == 0xF4) {
+            follow = 3;
+            hi = 0x8F;
+        } else {
+            return false;
+        }
+        if (len - i - 1 < follow) return false;
+        if (s[i + 1] < lo || s[i + 1] > hi) return false;
+        for (size_t k = 2; k <= follow; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return false;
+        }
+        i += follow + 1;
+    }
+}
+
+/**
+ * @brief returns the line as valid UTF-8.
+ * Valid lines are returned as a view of the input without copying,
+ * anything else is transcoded from the fallback encoding into a buffer reused between calls,
+ * so the returned view is only valid until the next decode
+ *
+ * @param data
+ * @param len
+ * @return std::string_view
+ */
+std::string_view charset::decode(const char *data, size_t len) {
+    if (isUtf8(data, len)) return std::string_view(data, len);
+    transcode(data, len);
+    transcoded++;
+    return std::string_view(buffer);
+}
+
+/**
+ * @brief sets fallback encoding by name
+ * @note exported through ircController::setCharset
+ * @param name "latin1", "iso-8859-1", "cp1252" or "windows-1252"
+ * @return true
+ * @return false if name is not a known encoding
+ */
+bool charset::setFallback(std::string name) {
+    for (auto it = name.begin(); it != name.end(); it++) *it = std::tolower(*it);
+    if (name == "latin1" || name == "iso-8859-1") {
+        fallback = LATIN1;
+    } else if (name == "cp1252" || name == "windows-1252") {
+        fallback = CP1252;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void charset::setFallback(legacy fallback) {
+    this->fallback = fallback;
+}
+
+/**
+ * @brief heap bytes held by the transcoding buffer
+ *
+ * @return size_t
+ */
+size_t charset::memorySize() {
+    return buffer.capacity();
+}
+
+/**
+ * @brief releases the transcoding buffer, it is grown again on demand
+ */
+void charset::trim() {
+    std::string().swap(buffer);
+}
+
+void charset::transcode(const char *data, size_t len) {
+    const unsigned char *s = (const unsigned char *)data;
+    buffer.clear();
+    if (buffer.capacity() < len * 3) buffer.reserve(len * 3);
+    size_t i = 0;
+    while (i < len) {
+        size_t run = asciiPrefix(s + i, len - i);
+        buffer.append(data + i, run);
+        i += run;
+        if (i == len) break;
+        uint32_t cp = s[i++];
+        if (fallback == CP1252 && cp < 0xA0) cp = cp1252High[cp - 0x80];
+        appendCodepoint(buffer, cp);
+    }
+}
@@ -0,0 +1,194 @@
+#include "../include/eventBuffer.hpp"
+
+#include <cctype>
+#include <cstring>
+
+#include "../json/json11.hpp"
+
+// named commands get 1000 + their index, numerics their number, anything else -1
+static const char *commandNames[] = {"PRIVMSG", "NOTICE", "JOIN", "PART", "QUIT", "NICK", "MODE", "TOPIC", "KICK", "INVITE",
+                                     "PING", "PONG", "ERROR", "AWAY", "ACCOUNT", "CHGHOST", "SETNAME", "CAP", "WALLOPS",
+                                     "BATCH", "TAGMSG"};
+static const int32_t namedBase = 1000;
+
+eventBuffer::eventBuffer(internPool &pool) : pool(pool) {
+    head = oldest = mask = 0;
+    textHead = 0;
+    textLive = 0;
+    dropped = 0;
+    header.assign(HEADER_SIZE, 0);
+}
+
+/**
+ * @brief sizes the rings and drops every event
+ *
+ * @param events rounded up to a power of two, 0 turns the buffer off
+ * @param textBytes longer texts are cut to fit
+ */
+void eventBuffer::configure(size_t events, size_t textBytes) {
+    clear();
+    size_t capacity = 0;
+    if (events) {
+        capacity = 1;
+        while (capacity < events && capacity < ((size_t)1 << 24)) capacity <<= 1;
+    }
+    mask = capacity ? (uint32_t)capacity - 1 : 0;
+    // shrink_to_fit after assign so a smaller ring gives its memory back
+    commands.assign(capacity, 0);
+    senders.assign(capacity, 0);
+    targets.assign(capacity, 0);
+    textOffsets.assign(capacity, 0);
+    textLengths.assign(capacity, 0);
+    times.assign(capacity, 0);
+    text.assign(capacity ? textBytes : 0, '\0');
+    commands.shrink_to_fit();
+    senders.shrink_to_fit();
+    targets.shrink_to_fit();
+    textOffsets.shrink_to_fit();
+    textLengths.shrink_to_fit();
+    times.shrink_to_fit();
+    text.shrink_to_fit();
+    header[CAPACITY] = (int32_t)capacity;
+    header[TEXT_BYTES] = (int32_t)text.size();
+}
+
+bool eventBuffer::enabled() {
+    return commands.size();
+}
+
+/**
+ * @brief appends one event, dropping the oldest ones whose slot or text it needs.
+ * The target is the first parameter, the one after our nick for numerics, the text the trailing parameter
+ * unless it already is the target
+ *
+ * @param m
+ * @param time unix ms
+ */
+void eventBuffer::push(const message &m, double time) {
+    if (!enabled()) return;
+    if (head - oldest > mask) drop();
+
+    std::string_view target, body = m.trailing;
+    size_t first = std::isdigit((unsigned char)m.command[0]) && m.middle.size() >= 2 ? 1 : 0;
+    if (first < m.middle.size()) {
+        target = m.middle[first];
+    } else {
+        target = m.trailing;
+        body = std::string_view();
+    }
+    std::string_view sender = m.nick.size() ? m.nick : m.server;
+    if (body.size() > text.size()) body = body.substr(0, text.size());
+    place(body.size());
+
+    uint32_t slot = head & mask;
+    commands[slot] = commandId(m.command);
+    senders[slot] = sender.size() ? (int32_t)pool.intern(sender) : 0;
+    targets[slot] = target.size() ? (int32_t)pool.intern(target) : 0;
+    times[slot] = time;
+    textOffsets[slot] = (int32_t)textHead;
+    textLengths[slot] = (int32_t)body.size();
+    if (body.size()) std::memcpy(&text[textHead], body.data(), body.size());
+    textHead += (uint32_t)body.size();
+    textLive += body.size();
+    head++;
+    publish();
+}
+
+size_t eventBuffer::size() {
+    return head - oldest;
+}
+
+/**
+ * @brief drops every event and releases their names, a generation starts
+ */
+void eventBuffer::clear() {
+    while (head != oldest) drop();
+    head = oldest = 0;
+    textHead = 0;
+    textLive = 0;
+    header[GENERATION]++;
+    publish();
+}
+
+/**
+ * @brief
+ *
+ * @param command
+ * @return int32_t 0-999 for numerics, 1000 and up for the commands listed by commandTable, -1 for others
+ */
+int32_t eventBuffer::commandId(std::string_view command) {
+    if (command.size() == 3 && std::isdigit((unsigned char)command[0]) && std::isdigit((unsigned char)command[1]) &&
+        std::isdigit((unsigned char)command[2])) {
+        return (command[0] - '0') * 100 + (command[1] - '0') * 10 + (command[2] - '0');
+    }
+    for (size_t i = 0; i < sizeof(commandNames) / sizeof(*commandNames); i++) {
+        if (command == commandNames[i]) return namedBase + (int32_t)i;
+    }
+    return -1;
+}
+
+/**
+ * @brief
+ *
+ * @return std::string JSON object, command name to id
+ */
+std::string eventBuffer::commandTable() {
+    json11::Json::object ids;
+    for (size_t i = 0; i < sizeof(commandNames) / sizeof(*commandNames); i++) ids[commandNames[i]] = namedBase + (int)i;
+    return json11::Json(ids).dump();
+}
+
+/**
+ * @brief counts the intern pool references readable events hold, for a snapshot that does not keep them
+ *
+ * @param held added to, by id
+ */
+void eventBuffer::refs(std::unordered_map<uint32_t, uint32_t> &held) const {
+    for (uint32_t n = oldest; n != head; n++) {
+        uint32_t slot = n & mask;
+        if (senders[slot]) held[senders[slot]]++;
+        if (targets[slot]) held[targets[slot]]++;
+    }
+}
+
+memoryUsage eventBuffer::usage() {
+    memoryUsage ret;
+    ret.count = size();
+    ret.bytes = heapBytes(header) + heapBytes(commands) + heapBytes(senders) + heapBytes(targets) + heapBytes(textOffsets) +
+                heapBytes(textLengths) + heapBytes(times) + heapBytes(text);
+    ret.evicted = dropped;
+    return ret;
+}
+
+// makes len contiguous bytes free at textHead, starting over at 0 if they do not fit before the end
+void eventBuffer::place(size_t len) {
+    for (;;) {
+        // readable text runs from the oldest event's offset up to textHead, around the end if it wrapped
+        uint32_t tail = textLive ? (uint32_t)textOffsets[oldest & mask] : textHead;
+        if (!textLive || textHead > tail) {
+            if (textHead + len <= text.size()) return;
+            if (!textLive || len <= tail) {
+                textHead = 0;
+                header[GENERATION]++;
+                return;
+            }
+        } else if (textHead + len <= tail) {
+            return;
+        }
+        drop();
+    }
+}
+
+void eventBuffer::drop() {
+    uint32_t slot = oldest & mask;
+    if (senders[slot]) pool.release(senders[slot]);
+    if (targets[slot]) pool.release(targets[slot]);
+    textLive -= textLengths[slot];
+    oldest++;
+    dropped++;
+}
+
+void eventBuffer::publish() {
+    header[COMMIT] = (int32_t)head;
+    header[OLDEST] = (int32_t)oldest;
+}
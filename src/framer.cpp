@@ -0,0 +1,80 @@
+#include "../include/framer.hpp"
+
+#include <cstring>
+
+/**
+ * @brief Construct a new framer object
+ *
+ * @param stream true if chunks can end in the middle of a line
+ */
+framer::framer(bool stream) {
+    this->stream = stream;
+}
+
+/**
+ * @brief splits a chunk of (pointer, length) input into lines without CR/LF.
+ * The input does not have to be NUL terminated and lines are views into it,
+ * except for a line completing a previous partial one which points into an internal buffer.
+ * Views are valid until the next feed. Empty lines are dropped
+ *
+ * @param data
+ * @param len
+ * @param lines cleared and filled with the lines found
+ */
+void framer::feed(const char *data, size_t len, std::vector<std::string_view> &lines) {
+    lines.clear();
+    const char *end = data + len;
+    const char *start = data;
+
+    while (start < end) {
+        const char *lf = (const char *)std::memchr(start, '\n', end - start);
+        if (!lf) break;
+        const char *stop = lf;
+        if (stop > start && stop[-1] == '\r') stop--;
+
+        if (partial.size()) {
+            joined.swap(partial);
+            partial.clear();
+            joined.append(start, stop - start);
+            if (joined.size() && joined.back() == '\r') joined.pop_back();
+            if (joined.size()) lines.push_back(std::string_view(joined));
+        } else if (stop > start) {
+            lines.push_back(std::string_view(start, stop - start));
+        }
+        start = lf + 1;
+    }
+
+    if (start == end) return;
+    if (stream) {
+        partial.append(start, end - start);
+        return;
+    }
+    const char *stop = end;
+    if (stop[-1] == '\r') stop--;
+    if (stop > start) lines.push_back(std::string_view(start, stop - start));
+}
+
+/**
+ * @brief heap bytes held by line buffers
+ *
+ * @return size_t
+ */
+size_t framer::memorySize() {
+    return partial.capacity() + joined.capacity();
+}
+
+/**
+ * @brief releases line buffers, keeping a pending partial line
+ */
+void framer::trim() {
+    std::string(partial).swap(partial);
+    std::string().swap(joined);
+}
+
+/**
+ * @brief drops any partial line, used when the connection is reset
+ */
+void framer::reset() {
+    partial.clear();
+    joined.clear();
+}
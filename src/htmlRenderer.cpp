@@ -0,0 +1,203 @@
+#include "../include/htmlRenderer.hpp"
+
+#include <cctype>
+#include <cstring>
+
+// mIRC colours 16 to 98, 0 to 15 are the fgN and bgN classes of main.css so themes can change them
+static const char *const extendedColors[83] = {
+    "470000", "472100", "474700", "324700", "004700", "00472c", "004747", "002747", "000047", "2e0047", "470047", "47002a",
+    "740000", "743a00", "747400", "517400", "007400", "007449", "007474", "004074", "000074", "4b0074", "740074", "740045",
+    "b50000", "b56300", "b5b500", "7db500", "00b500", "00b571", "00b5b5", "0063b5", "0000b5", "7500b5", "b500b5", "b5006b",
+    "ff0000", "ff8c00", "ffff00", "b2ff00", "00ff00", "00ffa0", "00ffff", "008cff", "0000ff", "a500ff", "ff00ff", "ff0098",
+    "ff5959", "ffb459", "ffff71", "cfff60", "6fff6f", "65ffc9", "6dffff", "59b4ff", "5959ff", "c459ff", "ff66ff", "ff59bc",
+    "ff9c9c", "ffd39c", "ffff9c", "e2ff9c", "9cff9c", "9cffdb", "9cffff", "9cd3ff", "9c9cff", "dc9cff", "ff9cff", "ff94d3",
+    "000000", "131313", "282828", "363636", "4d4d4d", "656565", "818181", "9f9f9f", "bcbcbc", "e2e2e2", "ffffff"};
+
+// reads the one or two digits of a colour number, 99 and no digits at all mean the default colour
+static int readColor(std::string_view text, size_t &at) {
+    if (at >= text.size() || !std::isdigit((unsigned char)text[at])) return -1;
+    int value = text[at++] - '0';
+    if (at < text.size() && std::isdigit((unsigned char)text[at])) value = value * 10 + (text[at++] - '0');
+    return value == 99 ? -1 : value;
+}
+
+static bool startsWith(std::string_view text, size_t at, const char *prefix) {
+    size_t n = std::strlen(prefix);
+    if (text.size() - at < n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (std::tolower((unsigned char)text[at + i]) != prefix[i]) return false;
+    }
+    return true;
+}
+
+bool htmlRenderer::style::operator==(const style &o) const {
+    return bold == o.bold && italic == o.italic && underline == o.underline && fg == o.fg && bg == o.bg;
+}
+
+htmlRenderer::htmlRenderer() {
+}
+
+/**
+ * @brief starts a new batch, the buffer keeps its capacity
+ */
+void htmlRenderer::clear() {
+    out.clear();
+}
+
+/**
+ * @brief appends one conversation line as a <p>, CTCP ACTIONs are shown as "* nick text"
+ *
+ * @param nick sender
+ * @param text the trailing parameter, mIRC formatting included
+ * @param own a line we sent, styled apart
+ */
+void htmlRenderer::line(std::string_view nick, std::string_view text, bool own) {
+    bool action = text.size() > 8 && !text.compare(0, 8, "\x01" "ACTION ");
+    if (action) {
+        text.remove_prefix(8);
+        if (text.back() == '\x01') text.remove_suffix(1);
+    }
+    out += own ? (action ? "<p class=\"own action\">" : "<p class=\"own\">") : (action ? "<p class=\"action\">" : "<p>");
+    out += action ? "<span class=\"nick\">* " : "<span class=\"nick\">";
+    escape(nick);
+    out += action ? " </span>" : ": </span>";
+    format(text);
+    out += "</p>";
+}
+
+const std::string &htmlRenderer::html() {
+    return out;
+}
+
+memoryUsage htmlRenderer::usage() {
+    memoryUsage ret;
+    ret.bytes = heapBytes(out);
+    ret.count = out.size();
+    return ret;
+}
+
+// a span is only opened in front of visible text, so formatting that is toggled back and forth leaves nothing behind
+void htmlRenderer::format(std::string_view text) {
+    style current, shown;
+    bool open = false;
+    size_t at = 0;
+    while (at < text.size()) {
+        unsigned char c = text[at];
+        if (c < 0x20) {
+            at++;
+            if (c == 0x02) {
+                current.bold = !current.bold;
+            } else if (c == 0x1D) {
+                current.italic = !current.italic;
+            } else if (c == 0x1F) {
+                current.underline = !current.underline;
+            } else if (c == 0x0F) {
+                current = style();
+            } else if (c == 0x03) {
+                // \x03 alone resets both colours, a comma only belongs to the code when a digit follows it
+                current.fg = readColor(text, at);
+                if (current.fg < 0 && (at >= text.size() || text[at] != ',')) {
+                    current.bg = -1;
+                } else if (at + 1 < text.size() && text[at] == ',' && std::isdigit((unsigned char)text[at + 1])) {
+                    at++;
+                    current.bg = readColor(text, at);
+                }
+            }
+            continue;
+        }
+        if (!(current == shown)) {
+            if (open) out += "</span>";
+            open = !(current == style());
+            if (open) openSpan(current);
+            shown = current;
+        }
+        size_t link = linkLength(text, at);
+        if (link) {
+            std::string_view url = text.substr(at, link);
+            out += "<a href=\"";
+            if (url[0] == 'w' || url[0] == 'W') out += "http://";
+            escape(url);
+            out += "\" target=\"_blank\" rel=\"noopener noreferrer\">";
+            escape(url);
+            out += "</a>";
+            at += link;
+            continue;
+        }
+        // runs of plain text are copied at once
+        size_t end = at + 1;
+        while (end < text.size() && (unsigned char)text[end] >= 0x20 && !std::strchr("&<>\"'hHwW", text[end])) end++;
+        escape(text.substr(at, end - at));
+        at = end;
+    }
+    if (open) out += "</span>";
+}
+
+void htmlRenderer::openSpan(const style &s) {
+    out += "<span class=\"";
+    size_t start = out.size();
+    if (s.bold) out += " b";
+    if (s.italic) out += " i";
+    if (s.underline) out += " u";
+    if (s.fg >= 0 && s.fg < 16) out += " fg" + std::to_string(s.fg);
+    if (s.bg >= 0 && s.bg < 16) out += " bg" + std::to_string(s.bg);
+    if (out.size() > start) out.erase(start, 1);
+    out += "\"";
+    if (s.fg >= 16 || s.bg >= 16) {
+        out += " style=\"";
+        if (s.fg >= 16) out += "color:#" + std::string(extendedColors[s.fg - 16]) + ";";
+        if (s.bg >= 16) out += "background-color:#" + std::string(extendedColors[s.bg - 16]) + ";";
+        out += "\"";
+    }
+    out += ">";
+}
+
+void htmlRenderer::escape(std::string_view text) {
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        const char *entity;
+        switch (text[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&#39;"; break;
+            default: continue;
+        }
+        out.append(text.data() + start, i - start);
+        out += entity;
+        start = i + 1;
+    }
+    out.append(text.data() + start, text.size() - start);
+}
+
+// length of an http(s):// or www. link starting at a word boundary, 0 if there is none.
+// The link ends at a space or control byte, trailing punctuation and an unbalanced ')' are left out
+size_t htmlRenderer::linkLength(std::string_view text, size_t at) {
+    if (at && std::isalnum((unsigned char)text[at - 1])) return 0;
+    size_t scheme;
+    if (startsWith(text, at, "https://")) {
+        scheme = 8;
+    } else if (startsWith(text, at, "http://")) {
+        scheme = 7;
+    } else if (startsWith(text, at, "www.")) {
+        scheme = 4;
+    } else {
+        return 0;
+    }
+    size_t end = at + scheme, open = 0, close = 0;
+    while (end < text.size() && (unsigned char)text[end] > 0x20 && !std::strchr("<>\"", text[end])) {
+        if (text[end] == '(') open++;
+        if (text[end] == ')') close++;
+        end++;
+    }
+    while (end > at + scheme) {
+        char last = text[end - 1];
+        if (last == ')' && close > open) {
+            close--;
+        } else if (!std::strchr(".,;:!?'", last)) {
+            break;
+        }
+        end--;
+    }
+    return end > at + scheme ? end - at : 0;
+}
@@ -0,0 +1,145 @@
+#include "../include/ingestScheduler.hpp"
+
+#include <chrono>
+
+#include "../json/json11.hpp"
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ingestScheduler::ingestScheduler() {
+    budget = 0;
+    next = 0;
+    cost = 2000;
+    slices = lines = lastSlice = maxSlice = 0;
+}
+
+/**
+ * @brief sets the time a slice may take
+ *
+ * @param ns 0 disables slicing, lines are then handled as they arrive
+ */
+void ingestScheduler::setBudget(uint64_t ns) {
+    budget = ns;
+}
+
+bool ingestScheduler::enabled() {
+    return budget;
+}
+
+/**
+ * @brief queues a received line, the view does not have to outlive the call
+ *
+ * @param line
+ */
+void ingestScheduler::push(std::string_view line) {
+    backlog.append(line.data(), line.size());
+    ends.push_back((uint32_t)backlog.size());
+}
+
+bool ingestScheduler::pending() {
+    return next < ends.size();
+}
+
+size_t ingestScheduler::queued() {
+    return ends.size() - next;
+}
+
+/**
+ * @brief handles queued lines for at most one budget.
+ * Each chunk is sized to fill half of the remaining time at the measured cost per line,
+ * so a slice overshoots its budget by at most the cost of one line when the estimate is right
+ *
+ * @param handle called for every line in arrival order
+ * @param drain ignore the budget and handle everything queued
+ * @return size_t lines handled
+ */
+size_t ingestScheduler::run(const std::function<void(std::string_view)> &handle, bool drain) {
+    if (!pending()) return 0;
+    if (overBudget()) {
+        drain = true;
+        stats.evicted++;
+    }
+    uint64_t start = nowNs(), now = start;
+    size_t handled = 0;
+    while (pending()) {
+        size_t chunk = ends.size() - next;
+        if (!drain) {
+            uint64_t spent = now - start;
+            if (spent >= budget && handled) break;
+            double fit = spent < budget ? (budget - spent) / (2 * cost) : 0;
+            if (fit < chunk) chunk = fit < 1 ? 1 : (size_t)fit;
+        }
+        uint64_t chunkStart = now;
+        for (size_t i = 0; i < chunk; i++) handle(line(next++));
+        handled += chunk;
+        now = nowNs();
+        cost = (cost * 3 + (double)(now - chunkStart) / chunk) / 4;
+    }
+    slices++;
+    lines += handled;
+    lastSlice = now - start;
+    if (lastSlice > maxSlice) maxSlice = lastSlice;
+    compact();
+    return handled;
+}
+
+/**
+ * @brief caps the backlog, past it the next run handles everything queued regardless of the slice budget
+ * and counts it as evicted
+ *
+ * @param bytes 0 for unbounded
+ */
+void ingestScheduler::setMemoryBudget(size_t bytes) {
+    stats.budget = bytes;
+}
+
+bool ingestScheduler::overBudget() {
+    return stats.budget && usage().bytes > stats.budget;
+}
+
+memoryUsage ingestScheduler::usage() {
+    memoryUsage ret = stats;
+    ret.count = ends.size() - next;
+    ret.bytes = heapBytes(backlog) + heapBytes(ends);
+    return ret;
+}
+
+/**
+ * @brief
+ *
+ * @return std::string json {"budgetMs", "pending", "slices", "lines", "costNs", "lastSliceMs", "maxSliceMs"}
+ */
+std::string ingestScheduler::statsJson() {
+    json11::Json ret = json11::Json::object{
+        {"budgetMs", budget / 1e6},
+        {"pending", (double)(ends.size() - next)},
+        {"slices", (double)slices},
+        {"lines", (double)lines},
+        {"costNs", cost},
+        {"lastSliceMs", lastSlice / 1e6},
+        {"maxSliceMs", maxSlice / 1e6}};
+    return ret.dump();
+}
+
+std::string_view ingestScheduler::line(size_t i) {
+    size_t begin = i ? ends[i - 1] : 0;
+    return std::string_view(backlog.data() + begin, ends[i] - begin);
+}
+
+// drops handled lines, everything at once when the backlog is empty or by moving the tail down past half
+void ingestScheduler::compact() {
+    if (next == ends.size()) {
+        backlog.clear();
+        ends.clear();
+        next = 0;
+        return;
+    }
+    if (!next || next < ends.size() / 2) return;
+    uint32_t shift = ends[next - 1];
+    backlog.erase(0, shift);
+    for (size_t i = next; i < ends.size(); i++) ends[i - next] = ends[i] - shift;
+    ends.resize(ends.size() - next);
+    next = 0;
+}
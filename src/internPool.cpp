@@ -0,0 +1,300 @@
+#include "../include/internPool.hpp"
+
+#include <algorithm>
+
+#include "../include/isupport.hpp"
+
+internPool::internPool() {
+    // rfc1459 until the server tells its casemapping
+    fold = isupport::foldTable(isupport::RFC1459);
+    live = dead = 0;
+}
+
+/**
+ * @brief switches the casefold table and rehashes every name.
+ * Names that only become equal under the new table keep their own ids, set it before state piles up
+ *
+ * @param table 256 entry table mapping a byte to its folded form
+ */
+void internPool::setCasemapping(const unsigned char *table) {
+    fold = table ? table : isupport::foldTable(isupport::RFC1459);
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].refs) entries[i].hash = hash(view(i + 1));
+    }
+    std::vector<uint32_t>().swap(slots);
+    grow();
+}
+
+/**
+ * @brief returns the id of a name, adding it if needed, and takes a reference on it
+ *
+ * @param name
+ * @return uint32_t id, 0 for an empty name
+ */
+uint32_t internPool::intern(std::string_view name) {
+    if (name.empty()) return 0;
+    uint32_t id = find(name);
+    if (id) {
+        entries[id - 1].refs++;
+        return id;
+    }
+    entry e;
+    e.offset = (uint32_t)arena.size();
+    e.length = (uint32_t)name.size();
+    e.refs = 1;
+    e.hash = hash(name);
+    arena.append(name.data(), name.size());
+    live += name.size();
+    if (freeIds.size()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+        entries[id - 1] = e;
+    } else {
+        entries.push_back(e);
+        id = (uint32_t)entries.size();
+    }
+    if ((entries.size() - freeIds.size()) * 4 > slots.size() * 3) {
+        grow();
+    } else {
+        place(id);
+    }
+    return id;
+}
+
+/**
+ * @brief looks a name up without taking a reference
+ *
+ * @param name
+ * @return uint32_t id, 0 if unknown
+ */
+uint32_t internPool::find(std::string_view name) const {
+    if (slots.empty() || name.empty()) return 0;
+    uint32_t h = hash(name);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        uint32_t id = slots[i];
+        if (!id) return 0;
+        if (entries[id - 1].hash == h && equal(view(id), name)) return id;
+    }
+}
+
+void internPool::retain(uint32_t id) {
+    if (id) entries[id - 1].refs++;
+}
+
+/**
+ * @brief drops a reference, the id is reused once nobody holds it anymore
+ *
+ * @param id
+ */
+void internPool::release(uint32_t id) {
+    if (!id || id > entries.size() || !entries[id - 1].refs) return;
+    entry &e = entries[id - 1];
+    if (--e.refs) return;
+    unplace(id);
+    live -= e.length;
+    dead += e.length;
+    e.length = 0;
+    freeIds.push_back(id);
+    if (dead > 4096 && dead > live) compact();
+}
+
+/**
+ * @brief changes how a name is spelled, for a nick that only changed case
+ *
+ * @param id
+ * @param name must be equal to the current name under the casemapping
+ */
+void internPool::respell(uint32_t id, std::string_view name) {
+    if (!id || !equal(view(id), name) || view(id) == name) return;
+    entry &e = entries[id - 1];
+    dead += e.length;
+    e.offset = (uint32_t)arena.size();
+    arena.append(name.data(), name.size());
+}
+
+std::string_view internPool::view(uint32_t id) const {
+    if (!id || id > entries.size()) return std::string_view();
+    return std::string_view(arena.data() + entries[id - 1].offset, entries[id - 1].length);
+}
+
+std::string internPool::name(uint32_t id) const {
+    return std::string(view(id));
+}
+
+/**
+ * @brief compares two names under the casemapping
+ *
+ * @param a
+ * @param b
+ * @return true if equal
+ */
+bool internPool::equal(std::string_view a, std::string_view b) const {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (fold[(unsigned char)a[i]] != fold[(unsigned char)b[i]]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief orders two names under the casemapping, byte by byte on their folded forms
+ *
+ * @param a
+ * @param b
+ * @return int negative, 0 or positive as a sorts before, with or after b
+ */
+int internPool::compare(std::string_view a, std::string_view b) const {
+    size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+        int diff = (int)fold[(unsigned char)a[i]] - (int)fold[(unsigned char)b[i]];
+        if (diff) return diff;
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+/**
+ * @brief forgets every name, for a new connection
+ */
+void internPool::clear() {
+    arena.clear();
+    entries.clear();
+    slots.clear();
+    freeIds.clear();
+    live = dead = 0;
+}
+
+/**
+ * @brief writes the names the snapshot's holders reference. References of holders that are not saved
+ * are left out of the counts, a name only they hold is written as free
+ *
+ * @param s
+ * @param unsaved references by id taken by holders the snapshot does not keep
+ */
+void internPool::save(snapshot &s, const std::unordered_map<uint32_t, uint32_t> &unsaved) const {
+    if (unsaved.empty()) return write(s);
+    internPool kept(*this);
+    for (auto it = unsaved.begin(); it != unsaved.end(); it++) {
+        for (uint32_t n = 0; n < it->second; n++) kept.release(it->first);
+    }
+    kept.write(s);
+}
+
+// the arena and the id, slot and free tables as they are
+void internPool::write(snapshot &s) const {
+    s.putVarint(entries.size());
+    s.putBlob(entries.data(), entries.size() * sizeof(entry));
+    s.putVarint(slots.size());
+    s.putBlob(slots.data(), slots.size() * sizeof(uint32_t));
+    s.putVarint(freeIds.size());
+    s.putBlob(freeIds.data(), freeIds.size() * sizeof(uint32_t));
+    s.putString(arena);
+    s.putVarint(live);
+    s.putVarint(dead);
+}
+
+/**
+ * @brief replaces every name with the saved ones, ids and reference counts included.
+ * The tables are copied back without rehashing, the casemapping has to be the one they were saved with
+ *
+ * @param s
+ * @return true
+ * @return false if the image is damaged, the pool is then empty
+ */
+bool internPool::restore(snapshot &s) {
+    clear();
+    // sizes are checked against the image before anything is allocated
+    size_t count = s.getVarint();
+    if (count > s.size() / sizeof(entry)) return false;
+    entries.resize(count);
+    s.getBlob(entries.data(), count * sizeof(entry));
+    count = s.getVarint();
+    if (count > s.size() / sizeof(uint32_t) || (count & (count - 1))) {
+        clear();
+        return false;
+    }
+    slots.resize(count);
+    s.getBlob(slots.data(), count * sizeof(uint32_t));
+    count = s.getVarint();
+    if (count > s.size() / sizeof(uint32_t)) {
+        clear();
+        return false;
+    }
+    freeIds.resize(count);
+    s.getBlob(freeIds.data(), count * sizeof(uint32_t));
+    arena = s.getString();
+    live = s.getVarint();
+    dead = s.getVarint();
+
+    bool valid = s.ok();
+    for (size_t i = 0; valid && i < entries.size(); i++) valid = (size_t)entries[i].offset + entries[i].length <= arena.size();
+    for (size_t i = 0; valid && i < slots.size(); i++) valid = slots[i] <= entries.size();
+    for (size_t i = 0; valid && i < freeIds.size(); i++) valid = freeIds[i] && freeIds[i] <= entries.size();
+    if (!valid) clear();
+    return valid;
+}
+
+memoryUsage internPool::usage() {
+    memoryUsage ret;
+    ret.count = entries.size() - freeIds.size();
+    ret.bytes = heapBytes(arena) + heapBytes(entries) + heapBytes(slots) + heapBytes(freeIds);
+    return ret;
+}
+
+// FNV-1a over the folded name
+uint32_t internPool::hash(std::string_view name) const {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < name.size(); i++) {
+        h ^= fold[(unsigned char)name[i]];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void internPool::place(uint32_t id) {
+    size_t mask = slots.size() - 1;
+    size_t i = entries[id - 1].hash & mask;
+    while (slots[i]) i = (i + 1) & mask;
+    slots[i] = id;
+}
+
+// removes an id from the slot table, shifting back the entries of its probe run so no tombstones are left
+void internPool::unplace(uint32_t id) {
+    size_t mask = slots.size() - 1;
+    size_t i = entries[id - 1].hash & mask;
+    while (slots[i] != id) i = (i + 1) & mask;
+    for (size_t j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+        size_t home = entries[slots[j] - 1].hash & mask;
+        // the entry at j may move to i only if its home is not within (i, j]
+        bool between = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (between) continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i] = 0;
+}
+
+// doubles the slot table (or sizes it for the live names) and places every live id again
+void internPool::grow() {
+    size_t count = entries.size() - freeIds.size();
+    size_t size = std::max<size_t>(64, slots.size());
+    while (count * 4 > size * 3) size *= 2;
+    std::vector<uint32_t>(size, 0).swap(slots);
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].refs) place((uint32_t)(i + 1));
+    }
+}
+
+// rewrites the arena with live names only, ids do not change
+void internPool::compact() {
+    std::string packed;
+    packed.reserve(live);
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        if (!it->refs) continue;
+        uint32_t offset = (uint32_t)packed.size();
+        packed.append(arena, it->offset, it->length);
+        it->offset = offset;
+    }
+    arena.swap(packed);
+    dead = 0;
+}
@@ -1,5 +1,23 @@
 #include "../include/ircController.hpp"
 
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#include <emscripten/eventloop.h>
+#endif
+
+// what fetching missed messages after a reconnect needs: CHATHISTORY replies come in a batch, with their time
+static std::vector<std::string> historyCaps(bool reconnect) {
+    if (!reconnect) return {};
+    return {"draft/chathistory", "batch", "server-time", "message-tags"};
+}
+
 ircController *ircC;
 int ircController::websocket;
 
@@ -8,11 +26,75 @@ int ircController::websocket;
  * @note exported
  * @param debug
  */
-ircController::ircController(bool debug) {
+ircController::ircController(bool debug) : conversations(pool), members(pool), events(pool), presence(pool) {
     ircC = this;
     this->debug = debug;
+    profiling = false;
+    stages = {};
+    foldTable = settings.foldTable();
+    lagTimer = drainTimer = autosaveTimer = reconnectTimer = presenceTimer = 0;
+    lastSeen = 0;
+    reconnecting = quitting = false;
+    hostTimer = 0;
+    hostAt = 0;
+    revision = savedRevision = 0;
+    resumed = false;
+    session.setImplied(historyCaps(retry.enabled()));
 };
 
+#ifdef __EMSCRIPTEN__
+// runs once per animation frame while ingest slicing is on
+static void schedulerTick() {
+    if (ircC != nullptr) ircC->runSlice();
+}
+#endif
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t nowMs() {
+    return nowNs() / 1000000;
+}
+
+// wall clock, for timestamps the server understands
+static uint64_t unixMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 2024-01-31T12:34:56.789Z
+static std::string isoTime(uint64_t ms) {
+    time_t seconds = (time_t)(ms / 1000);
+    struct tm t;
+    gmtime_r(&seconds, &t);
+    char text[32];
+    size_t n = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &t);
+    std::snprintf(text + n, sizeof(text) - n, ".%03uZ", (unsigned)(ms % 1000));
+    return text;
+}
+
+// control lines that take the priority lane of the outbound queue
+static bool priorityLine(std::string_view line) {
+    std::string_view command = line.substr(0, line.find(' '));
+    return command == "PONG" || command == "PING" || command == "QUIT";
+}
+
+#ifdef __EMSCRIPTEN__
+// the one browser timer behind every timer of the wheel
+static void timerTick(void *) {
+    if (ircC == nullptr) return;
+    ircC->hostTimer = 0;
+    ircC->runTimers();
+}
+#endif
+
+// scrollback kept per queue in a snapshot
+static const size_t snapshotTail = 200;
+// a request that gets no reply for this long is failed
+static const uint64_t requestIdleMs = 60000;
+// WHO lines a presence refresh round may send
+static const size_t presenceLines = 8;
+
 /**
  * @brief Return websocket value, if value is 0 then there is no connection
  * @note exported
@@ -28,7 +110,44 @@ int ircController::getWebsocketConnection() {
  * @return std::vector<std::string>
  */
 std::vector<std::string> ircController::getChannels() {
-    return channels;
+    std::vector<std::string> ret;
+    for (auto it = channels.begin(); it != channels.end(); it++) ret.push_back(pool.name(*it));
+    return ret;
+}
+
+/**
+ * @brief members of a joined channel as the server reported them through JOIN, PART, QUIT, KICK, NICK and NAMES
+ * @note exported
+ * @param channel
+ * @return std::string json array of nicks with their highest prefix, highest first, "[]" if not in the channel
+ */
+std::string ircController::getMembers(std::string channel) {
+    return members.members(channel);
+}
+
+/**
+ * @brief nicks in a joined channel starting with prefix, ignoring case as the server does, for tab completion
+ * @note exported
+ * @param channel
+ * @param prefix
+ * @param limit at most this many, 0 for all
+ * @return std::string json array of nicks, who spoke last first, "[]" if not in the channel
+ */
+std::string ircController::completeNick(std::string channel, std::string prefix, int limit) {
+    return members.complete(channel, prefix, limit > 0 ? limit : 0);
+}
+
+/**
+ * @brief cached account, away state, realname and host of a user, without asking the server.
+ * With setPresenceRefresh on, a stale entry is refreshed on the next round, call again later for the answer
+ * @note exported
+ * @param nick
+ * @return std::string json {"nick", "user", "host", "account", "realname", "away", "awayMessage", "online",
+ * "lastSeen", "refreshed", "watched"}, account "*" when logged out, away and online null while unknown,
+ * empty if nothing is known yet, the nick is then asked for on the next round if refreshing is on
+ */
+std::string ircController::getPresence(std::string nick) {
+    return presence.lookup(nick, unixMs(), settings);
 }
 
 /**
@@ -40,29 +159,801 @@ void ircController::setDebug(bool _debug) {
     debug = _debug;
 }
 
+/**
+ * @brief set encoding assumed for incoming lines that are not valid UTF-8
+ * @note exported
+ * @param name "latin1"/"iso-8859-1" or "cp1252"/"windows-1252"
+ * @return true
+ * @return false if encoding is unknown
+ */
+bool ircController::setCharset(std::string name) {
+    return decoder.setFallback(name);
+}
+
+/**
+ * @brief turns per-stage timing of the ingest path on or off, see stages
+ * @note exported
+ * @param _profiling
+ */
+void ircController::setProfiling(bool _profiling) {
+    profiling = _profiling;
+}
+
+/**
+ * @brief records every received line with its arrival time into a capture file
+ * that tools/replay can feed back through the ingest path
+ * @note exported
+ * @param path in the browser a MEMFS path, read it back with FS.readFile
+ * @return true
+ * @return false if file could not be created
+ */
+bool ircController::startCapture(std::string path) {
+    return recorder.open(path);
+}
+
+/**
+ * @brief stops and flushes the running capture
+ * @note exported
+ */
+void ircController::stopCapture() {
+    recorder.close();
+}
+
+/**
+ * @brief reports live bytes and element counts of every container, their budgets and evictions,
+ * plus allocator totals from mallinfo to cross-check against
+ * @note exported
+ * @return std::string json object keyed by subsystem
+ */
+std::string ircController::getMemoryUsage() {
+    channelStats.count = channels.size();
+    channelStats.bytes = heapBytes(channels);
+    parserStats.count = lines.capacity();
+    parserStats.bytes = parserBytes();
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    json11::Json::object heap = {
+        {"arena", (double)info.arena},
+        {"inUse", (double)info.uordblks},
+        {"free", (double)info.fordblks}};
+#ifdef __EMSCRIPTEN__
+    heap["linearMemory"] = (double)(__builtin_wasm_memory_size(0) * 65536);
+#endif
+
+    json11::Json usage = json11::Json::object{
+        {"messages", messages.usage().asJson()},
+        {"infoMessages", infoMessages.usage().asJson()},
+        {"targets", conversations.usage().asJson()},
+        {"requests", requests.usage().asJson()},
+        {"directory", directory.usage().asJson()},
+        {"channels", channelStats.asJson()},
+        {"parser", parserStats.asJson()},
+        {"names", pool.usage().asJson()},
+        {"roster", members.usage().asJson()},
+        {"scheduler", scheduler.usage().asJson()},
+        {"outbound", outbound.usage().asJson()},
+        {"timers", timers.usage().asJson()},
+        {"html", html.usage().asJson()},
+        {"log", log.usage().asJson()},
+        {"events", events.usage().asJson()},
+        {"presence", presence.usage().asJson()},
+        {"heap", heap}};
+    return usage.dump();
+}
+
+/**
+ * @brief sets a byte budget for one subsystem, 0 removes it.
+ * Message queues drop their oldest entries, parser scratch buffers are released after the frame
+ * that grew them, channels stop accepting joins once the budget is reached and a scheduler backlog past it is handled at once
+ * @note exported
+ * @param subsystem "messages", "infoMessages", "targets" (per target), "requests" (per request), "directory", "channels", "parser",
+ * "presence" (1 MiB by default) or "scheduler"
+ * @param bytes
+ * @return true
+ * @return false if subsystem is unknown
+ */
+bool ircController::setMemoryBudget(std::string subsystem, double bytes) {
+    size_t budget = bytes > 0 ? (size_t)bytes : 0;
+    if (subsystem == "messages") {
+        messages.setBudget(budget);
+    } else if (subsystem == "infoMessages") {
+        infoMessages.setBudget(budget);
+    } else if (subsystem == "targets") {
+        conversations.setBudget(budget);
+    } else if (subsystem == "requests") {
+        requests.setBudget(budget);
+    } else if (subsystem == "directory") {
+        directory.setBudget(budget);
+    } else if (subsystem == "channels") {
+        channelStats.budget = budget;
+    } else if (subsystem == "parser") {
+        parserStats.budget = budget;
+    } else if (subsystem == "presence") {
+        presence.setBudget(budget);
+    } else if (subsystem == "scheduler") {
+        scheduler.setMemoryBudget(budget);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief handles received lines in time slices instead of inside the websocket callback.
+ * Lines are queued on arrival and handled once per animation frame for at most ms milliseconds,
+ * so a burst of thousands of lines no longer blocks input and paint
+ * @note exported
+ * @param ms slice budget, 0 handles lines as they arrive (default)
+ */
+void ircController::setIngestBudget(double ms) {
+#ifdef __EMSCRIPTEN__
+    bool was = scheduler.enabled();
+#endif
+    scheduler.setBudget(ms > 0 ? (uint64_t)(ms * 1e6) : 0);
+    if (!scheduler.enabled()) scheduler.run([this](std::string_view line) { categorizeMsg(line); }, true);
+#ifdef __EMSCRIPTEN__
+    if (scheduler.enabled() && !was) {
+        // fps 0 follows requestAnimationFrame
+        emscripten_set_main_loop(schedulerTick, 0, 0);
+    } else if (!scheduler.enabled() && was) {
+        emscripten_cancel_main_loop();
+    }
+#endif
+}
+
+/**
+ * @brief
+ * @note exported
+ * @return std::string json {"budgetMs", "pending", "slices", "lines", "costNs", "lastSliceMs", "maxSliceMs"}
+ */
+std::string ircController::getSchedulerStats() {
+    return scheduler.statsJson();
+}
+
+/**
+ * @brief paces outgoing lines so the server's flood protection does not disconnect us.
+ * PONG, lag PINGs and QUIT skip the queue, everything else waits for its turn
+ * @note exported
+ * @param linesPerSecond 0 sends everything right away (default)
+ * @param burst lines that may go back to back after a quiet period
+ */
+void ircController::setPacing(double linesPerSecond, int burst) {
+    outbound.setPacing(linesPerSecond, burst > 0 ? burst : 1);
+    flushOutbound();
+}
+
+/**
+ * @brief sends a PING with a cookie every few seconds once registered, see getLagStats
+ * @note exported
+ * @param seconds 0 stops them
+ */
+void ircController::setLagInterval(double seconds) {
+    timers.cancel(lagTimer);
+    lagTimer = seconds > 0 ? timers.every(nowMs(), (uint64_t)(seconds * 1000), [this]() { sendLagPing(); }) : 0;
+    armTimers();
+}
+
+/**
+ * @brief round trip to the server next to what waits on our side, so server lag and a slow client can be told apart
+ * @note exported
+ * @return std::string json {"currentMs", "averageMs", "maxMs", "samples", "lost", "outstanding", "outboundQueued",
+ * "ingestPending"}
+ */
+std::string ircController::getLagStats() {
+    return lag.statsJson(nowMs(), outbound.queued(), scheduler.queued());
+}
+
+/**
+ * @brief writes channels, members, server settings, interned names and the newest messages of every queue
+ * to a binary snapshot, see restoreSnapshot
+ * @note exported
+ * @param path in the browser a path on an IDBFS mount, call FS.syncfs to persist it
+ * @return true
+ * @return false if the file could not be written
+ */
+bool ircController::saveSnapshot(std::string path) {
+    snapshot s;
+    settings.save(s);
+    // presence entries and the event ring are not saved, their references would have no owner once restored
+    std::unordered_map<uint32_t, uint32_t> unsaved;
+    presence.refs(unsaved);
+    events.refs(unsaved);
+    pool.save(s, unsaved);
+    s.putString(session.nick);
+    s.putVarint(channels.size());
+    for (auto it = channels.begin(); it != channels.end(); it++) s.putVarint(*it);
+    members.save(s);
+    conversations.save(s, snapshotTail);
+    messages.save(s, snapshotTail);
+    infoMessages.save(s, snapshotTail);
+    if (!s.save(path)) return false;
+    savedRevision = revision;
+    return true;
+}
+
+/**
+ * @brief loads a snapshot written by saveSnapshot, replacing channels, members, settings and messages.
+ * Meant to be called on page load before openWebSocket so the UI is populated before the socket opens,
+ * the restored settings are kept until the server sends its own 005
+ * @note exported
+ * @param path
+ * @return true
+ * @return false if there is no snapshot, it is from another version or damaged, nothing is kept then
+ */
+bool ircController::restoreSnapshot(std::string path) {
+    snapshot s;
+    if (!s.load(path)) return false;
+    forget();
+    // settings first, the pool tables were saved with their casemapping
+    bool restored = settings.restore(s);
+    applySettings();
+    restored = restored && pool.restore(s);
+    session.nick = s.getString();
+    size_t count = s.getVarint();
+    for (size_t i = 0; restored && s.ok() && i < count; i++) channels.push_back((uint32_t)s.getVarint());
+    restored = restored && members.restore(s) && conversations.restore(s) && messages.restore(s) && infoMessages.restore(s);
+    if (!restored) {
+        forget();
+        settings.reset();
+        applySettings();
+        return false;
+    }
+    resumed = true;
+    savedRevision = ++revision;
+    return true;
+}
+
+/**
+ * @brief saves a snapshot every few seconds when something changed since the last one
+ * @note exported
+ * @param path
+ * @param seconds 0 stops saving
+ */
+void ircController::setAutosave(std::string path, double seconds) {
+    autosavePath = path;
+    timers.cancel(autosaveTimer);
+    autosaveTimer = 0;
+    if (seconds > 0) {
+        autosaveTimer = timers.every(nowMs(), (uint64_t)(seconds * 1000), [this]() {
+#ifdef __EMSCRIPTEN__
+            // persists the IDBFS mount once something was written
+            if (autosave()) EM_ASM(FS.syncfs(false, function(err) {}););
+#else
+            autosave();
+#endif
+        });
+    }
+    armTimers();
+}
+
+/**
+ * @brief saves to the autosave path if state changed since the last snapshot, called by its timer or by native tools
+ *
+ * @return true if a snapshot was written
+ */
+bool ircController::autosave() {
+    if (!autosaveTimer || autosavePath.empty() || revision == savedRevision) return false;
+    return saveSnapshot(autosavePath);
+}
+
+/**
+ * @brief starts logging every conversation to disk, channel messages, notices, joins, parts, kicks, topics and modes,
+ * queries under the other side's nick. Logged lines are written once per received frame or ingest slice
+ * @note exported
+ * @param dir directory of the log, created if needed, in the browser on MEMFS or an IDBFS mount
+ * @return true
+ * @return false if the directory cannot be used
+ */
+bool ircController::openLog(std::string dir) {
+    log.setCasemapping(foldTable);
+    return log.open(dir);
+}
+
+/**
+ * @brief stops logging, what is buffered is written first
+ * @note exported
+ */
+void ircController::closeLog() {
+    log.close();
+}
+
+/**
+ * @brief a page of logged history read straight from the log, older pages follow the returned cursor
+ * @note exported
+ * @param target channel or nick
+ * @param cursor 0 for the newest messages, otherwise the cursor of the last page or from seekHistory
+ * @param count messages per page
+ * @return std::string json {"cursor", "messages": [{"time", "message"}]} oldest first, cursor 0 once nothing older is left
+ */
+std::string ircController::getHistory(std::string target, double cursor, int count) {
+    return log.page(target, cursor > 0 ? (uint64_t)cursor : 0, count > 0 ? count : 0);
+}
+
+/**
+ * @brief cursor for getHistory whose page ends right before a point in time
+ * @note exported
+ * @param target
+ * @param time unix ms, e.g. Date.now()
+ * @return double cursor, 0 if every logged message is older
+ */
+double ircController::seekHistory(std::string target, double time) {
+    return (double)log.seek(target, time > 0 ? (uint64_t)time : 0);
+}
+
+/**
+ * @brief sends one lag PING, called by the interval timer or by native tools
+ */
+void ircController::sendLagPing() {
+    // only once registered, a server drops PINGs before that and a closed socket takes nothing.
+    // Native tools have no socket and drive the meter through their sink whatever the state
+    if (session.current != registration::REGISTERED && !sink) return;
+    send(lag.ping(nowMs()), true);
+}
+
+/**
+ * @brief sends one round of presence refreshes, called by the interval timer
+ */
+void ircController::refreshPresence() {
+    if (session.current != registration::REGISTERED) return;
+    std::vector<std::string> lines;
+    presence.refresh(unixMs(), members, settings, presenceLines, lines);
+    sendLines(lines);
+}
+
+/**
+ * @brief opens a tracked request, failed if it gets no reply for requestIdleMs
+ *
+ * @param type
+ * @param keys
+ * @return uint32_t handle
+ */
+uint32_t ircController::track(requestTracker::kind type, std::vector<std::string> keys) {
+    uint32_t id = requests.open(type, keys, nowMs());
+    timers.after(nowMs(), requestIdleMs, [this, id]() { expireRequest(id); });
+    armTimers();
+    return id;
+}
+
+// fails the request if it went quiet, otherwise checks again when it could
+void ircController::expireRequest(uint32_t id) {
+    uint64_t wait = requests.expire(id, nowMs(), requestIdleMs);
+    if (wait) timers.after(nowMs(), wait, [this, id]() { expireRequest(id); });
+}
+
+/**
+ * @brief runs the timers that are due, pacing, lag PINGs and autosave, and sets the host timer for the next one.
+ * Called from the browser timer, native tools call it themselves, the wheel follows the monotonic clock
+ *
+ * @return size_t timers run
+ */
+size_t ircController::runTimers() {
+    size_t fired = timers.advance(nowMs());
+    armTimers();
+    return fired;
+}
+
+// keeps one browser timer set for the wheel's next due time, an earlier one replaces it
+void ircController::armTimers() {
+#ifdef __EMSCRIPTEN__
+    uint64_t due = timers.nextDue();
+    if (!due || (hostTimer && hostAt <= due)) return;
+    if (hostTimer) emscripten_clear_timeout(hostTimer);
+    uint64_t now = nowMs();
+    hostAt = due;
+    hostTimer = emscripten_set_timeout(timerTick, due > now ? (double)(due - now) : 0, nullptr);
+#endif
+}
+
+/**
+ * @brief handles queued lines for one slice, called from the main loop or by native tools
+ *
+ * @return size_t lines handled
+ */
+size_t ircController::runSlice() {
+    size_t handled = scheduler.run([this](std::string_view line) { categorizeMsg(line); });
+    log.flush();
+    return handled;
+}
+
+/**
+ * @brief capabilities to request during registration, only those the server offers are asked for
+ * @note exported
+ * @param caps
+ */
+void ircController::setCapabilities(std::vector<std::string> caps) {
+    session.setCapabilities(caps);
+}
+
+/**
+ * @brief where the connection is between openWebSocket and 001
+ * @note exported
+ * @return std::string "disconnected", "reconnecting", "connecting", "open", "registering" or "registered"
+ */
+std::string ircController::getConnectionState() {
+    if (session.current == registration::DISCONNECTED && reconnectTimer) return "reconnecting";
+    return session.stateName();
+}
+
+/**
+ * @brief nick we are registered with, may differ from the one asked for after a collision
+ * @note exported
+ * @return std::string
+ */
+std::string ircController::getNick() {
+    return session.nick;
+}
+
+/**
+ * @brief writes parsed messages as columns into linear memory instead of the getNextMessage and
+ * getNextInfoMessage queues, see getEventViews. Replies to tracked requests, LIST rows and subscribed
+ * conversations are unaffected
+ * @note exported
+ * @param events ring size, rounded up to a power of two, 0 goes back to the queues
+ * @param textBytes size of the text ring, longer texts are cut
+ */
+void ircController::setEventBuffer(int events, int textBytes) {
+    this->events.configure(events > 0 ? events : 0, textBytes > 0 ? textBytes : 0);
+}
+
+/**
+ * @brief where the event buffer columns are in linear memory, for hosts without embind (the C ABI build).
+ * Byte offsets into the wasm memory, they change with setEventBuffer only
+ * @note exported
+ * @return std::string json {"header", "command", "sender", "target", "time", "textOffset", "textLength", "text",
+ * "capacity", "textBytes"}, header is 8 int32 (commit, oldest, generation, capacity, textBytes)
+ */
+std::string ircController::getEventLayout() {
+    json11::Json layout = json11::Json::object{
+        {"header", (double)(uintptr_t)events.header.data()},
+        {"command", (double)(uintptr_t)events.commands.data()},
+        {"sender", (double)(uintptr_t)events.senders.data()},
+        {"target", (double)(uintptr_t)events.targets.data()},
+        {"time", (double)(uintptr_t)events.times.data()},
+        {"textOffset", (double)(uintptr_t)events.textOffsets.data()},
+        {"textLength", (double)(uintptr_t)events.textLengths.data()},
+        {"text", (double)(uintptr_t)events.text.data()},
+        {"capacity", (double)events.commands.size()},
+        {"textBytes", (double)events.text.size()}};
+    return layout.dump();
+}
+
+/**
+ * @brief ids of the named commands in the event buffer, numerics are their number and anything else -1
+ * @note exported
+ * @return std::string json {"PRIVMSG": 1000, ...}
+ */
+std::string ircController::getEventCommands() {
+    return eventBuffer::commandTable();
+}
+
+/**
+ * @brief nick, server or channel behind a sender or target id, valid while an event holding it is readable
+ * @note exported
+ * @param id
+ * @return std::string
+ */
+std::string ircController::getEventName(int id) {
+    return id > 0 ? pool.name(id) : "";
+}
+
+/**
+ * @brief what the server advertised in 005, with defaults for what it did not
+ * @note exported
+ * @return std::string json {"casemapping", "chantypes", "prefix": {"modes", "symbols"}, "maxTargets", "targmax",
+ * "lineLen", "nickLen", "channelLen", "topicLen", "network", "tokens"}
+ */
+std::string ircController::getServerSettings() {
+    return settings.asJson();
+}
+
+/**
+ * @brief hands casemapping, prefixes and channel types to everything that hashes or classifies names
+ */
+void ircController::applySettings() {
+    const unsigned char *table = settings.foldTable();
+    if (table != foldTable) {
+        foldTable = table;
+        pool.setCasemapping(table);
+        directory.setCasemapping(table);
+        log.setCasemapping(table);
+        members.reindex();
+    }
+    members.setPrefixes(settings.prefixSymbols);
+    conversations.setChannelTypes(settings.chantypes);
+}
+
+/**
+ * @brief drops channels, members, conversations, queued messages and every interned name.
+ * Once every holder released its names the pool is empty, anything left is a leaked reference
+ *
+ * @return size_t names still referenced before the pool was cleared, 0 unless a reference leaked
+ */
+size_t ircController::forget() {
+    members.clear();
+    conversations.clear();
+    for (auto it = channels.begin(); it != channels.end(); it++) pool.release(*it);
+    channels.clear();
+    channelKeys.clear();
+    events.clear();
+    presence.clear();
+    size_t leaked = pool.usage().count;
+    if (debug && leaked) std::printf("[DEBUG][forget]: %zu names still referenced\n", leaked);
+    pool.clear();
+    while (!messages.empty()) messages.pop();
+    while (!infoMessages.empty()) infoMessages.pop();
+    return leaked;
+}
+
+/**
+ * @brief websocket created, commands sent from now on are held until 001
+ */
+void ircController::socketConnecting() {
+    timers.cancel(reconnectTimer);
+    reconnectTimer = 0;
+    quitting = false;
+    session.connecting();
+    // a restored snapshot describes the server we are reconnecting to
+    if (!resumed) settings.reset();
+    resumed = false;
+    applySettings();
+    if (!reconnecting) return;
+    // channels and what was left unsent wait for 001 and go out with it as one frame, the JOINs first
+    std::vector<std::string> names, keys;
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        names.push_back(pool.name(*it));
+        auto key = channelKeys.find(*it);
+        keys.push_back(key != channelKeys.end() ? key->second : "");
+    }
+    if (names.size()) joinList(views(names), views(keys));
+    std::vector<std::string> unsent;
+    unsent.swap(replay);
+    // JOINs are not replayed, their channels are tracked and joined above, those of a failed attempt included
+    for (auto it = unsent.begin(); it != unsent.end(); it++) {
+        if (it->compare(0, 5, "JOIN ")) sendMessage(*it);
+    }
+}
+
+/**
+ * @brief websocket open, sends the registration burst if registerUser was already called
+ */
+void ircController::socketOpened() {
+    std::string burst = session.opened();
+    if (burst.size()) send(burst, true);
+}
+
+/**
+ * @brief websocket closed or failed. Unless we quit, a reconnect is scheduled and the commands that were held
+ * or still queued are kept for it, otherwise they are dropped
+ */
+void ircController::socketClosed() {
+    // onerror and onclose both report the same loss
+    bool lost = session.current != registration::DISCONNECTED;
+    bool again = lost && !quitting && retry.enabled() && reopen && session.identified();
+    if (again) {
+        session.takeHeld(replay);
+        outbound.takeBulk(replay);
+    }
+    session.closed();
+    members.clear();
+    outbound.clear();
+    lag.reset();
+    presence.closed();
+    historyBatches.clear();
+    // their replies will not come, and must not be taken from the next connection's
+    requests.failAll("connection lost");
+    if (!again) return;
+    reconnecting = true;
+    reconnectTimer = timers.after(nowMs(), retry.next(), [this]() {
+        reconnectTimer = 0;
+        reopen();
+    });
+    armTimers();
+}
+
+/**
+ * @brief reconnects on its own after the socket is lost, with exponential backoff and jitter.
+ * Channels are joined again and unsent commands replayed in one frame once registered,
+ * messages missed meanwhile are fetched with CHATHISTORY when the server offers it, the capabilities that needs
+ * are requested while reconnecting is on
+ * @note exported
+ * @param initialSeconds delay before the first attempt, 0 turns reconnecting off (default 1)
+ * @param maxSeconds longest delay between attempts (default 60)
+ */
+void ircController::setReconnect(double initialSeconds, double maxSeconds) {
+    retry.configure(initialSeconds > 0 ? (uint64_t)(initialSeconds * 1000) : 0, maxSeconds > 0 ? (uint64_t)(maxSeconds * 1000) : 0);
+    session.setImplied(historyCaps(retry.enabled()));
+    if (retry.enabled()) return;
+    timers.cancel(reconnectTimer);
+    reconnectTimer = 0;
+    reconnecting = false;
+    replay.clear();
+}
+
+/**
+ * @brief keeps cached users fresh with WHOX: every intervalSeconds, the entries looked up with getPresence and the
+ * watched ones MONITOR does not cover are asked for once older than staleSeconds. Entries sharing a channel are
+ * asked for with one WHO on the channel, at most 8 lines a round. Needs WHOX, passive updates happen regardless
+ * @note exported
+ * @param staleSeconds 0 turns refreshing off (default)
+ * @param intervalSeconds
+ */
+void ircController::setPresenceRefresh(double staleSeconds, double intervalSeconds) {
+    presence.setStaleAfter(staleSeconds > 0 ? (uint64_t)(staleSeconds * 1000) : 0);
+    timers.cancel(presenceTimer);
+    presenceTimer = staleSeconds > 0 && intervalSeconds > 0 ? timers.every(nowMs(), (uint64_t)(intervalSeconds * 1000), [this]() { refreshPresence(); }) : 0;
+    armTimers();
+}
+
+// asks for what channels got while we were away, from the last line we received.
+// Without batch the replies could not be told from live lines
+void ircController::fetchMissed() {
+    auto found = settings.tokens.find("CHATHISTORY");
+    if (found == settings.tokens.end() || !lastSeen) return;
+    if (!session.enabled("draft/chathistory") || !session.enabled("batch")) return;
+    long limit = std::atol(found->second.c_str());
+    if (limit <= 0 || limit > 1000) limit = 1000;
+    std::string since = isoTime(lastSeen);
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        sendMessage("CHATHISTORY AFTER " + pool.name(*it) + " timestamp=" + since + " " + std::to_string(limit));
+    }
+}
+
+// a line of a CHATHISTORY reply: logged and queued as it was sent, it says nothing about channels or users now
+void ircController::replayed(message &m) {
+    uint64_t time = m.serverTime();
+    if (!time) time = unixMs();
+    if (log.isOpen()) {
+        std::string_view target = messageLog::targetOf(m, settings, session.nick);
+        if (target.size()) log.append(target, m.msg, time);
+    }
+    if (events.enabled()) return events.push(m, (double)time);
+    if (m.command != "PRIVMSG") return;
+    if (conversations.active()) {
+        conversations.route(std::move(m), session.nick);
+    } else {
+        messages.push(std::move(m));
+    }
+}
+
+size_t ircController::parserBytes() {
+    return decoder.memorySize() + frames.memorySize() + lines.capacity() * sizeof(std::string_view);
+}
+
+/**
+ * @brief splits a received frame into lines and categorizes each of them.
+ * Text and binary frames are both handed over as (pointer, length), no NUL terminator is needed
+ *
+ * @param data
+ * @param len
+ */
+void ircController::ingest(const char *data, size_t len) {
+    uint64_t start = profiling ? nowNs() : 0;
+    if (!reconnecting) lastSeen = unixMs();
+    frames.feed(data, len, lines);
+    if (profiling) stages.framing += nowNs() - start;
+    for (auto it = lines.begin(); it != lines.end(); it++) {
+        if (recorder.isOpen()) recorder.write(websocket, *it);
+        // PING and lag PONGs are answered and timed on arrival, not behind the backlog
+        if (control(*it)) continue;
+        if (scheduler.enabled()) {
+            scheduler.push(*it);
+        } else {
+            categorizeMsg(*it);
+        }
+    }
+    if (scheduler.overBudget()) runSlice();
+    // lines logged while handling this frame go out in one write
+    log.flush();
+    if (parserStats.budget && parserBytes() > parserStats.budget) {
+        decoder.trim();
+        frames.trim();
+        std::vector<std::string_view>().swap(lines);
+        parserStats.evicted++;
+    }
+}
+
 /**
  * @brief categorizes messages received.
  * Auto replies on PING
  * if categorize is false then all messages are loaded into messages
  * else separetes based on command, if digit then infoMessages else messages
+ * lines that are not valid UTF-8 are transcoded from the fallback charset first
  *
  * @param msg
  */
-void ircController::categorizeMsg(std::string msg) {
-    message m(msg, debug);
-    // if command is ping, sends pong back
-    if (m.command == "PING") pong(m.trailing);
+void ircController::categorizeMsg(std::string_view msg) {
+    if (!profiling) {
+        message m(decoder.decode(msg.data(), msg.size()), debug);
+        dispatch(m);
+        return;
+    }
+    uint64_t start = nowNs();
+    std::string_view line = decoder.decode(msg.data(), msg.size());
+    uint64_t decoded = nowNs();
+    message m(line, debug);
+    uint64_t parsed = nowNs();
+    dispatch(m);
+    uint64_t dispatched = nowNs();
+    stages.decoding += decoded - start;
+    stages.parsing += parsed - decoded;
+    stages.dispatching += dispatched - parsed;
+    stages.lines++;
+}
+
+/**
+ * @brief acts on a parsed message and files it into the matching queue
+ *
+ * @param m
+ */
+void ircController::dispatch(message &m) {
+    revision++;
+    // BATCH +<ref> chathistory <target> opens a CHATHISTORY reply, BATCH -<ref> closes it
+    if (m.command == "BATCH" && m.middle.size() && m.middle[0].size() > 1) {
+        std::string ref = m.middle[0].substr(1);
+        auto open = std::find(historyBatches.begin(), historyBatches.end(), ref);
+        if (m.middle[0][0] == '+' && m.middle.size() >= 2 && m.middle[1] == "chathistory") {
+            if (open == historyBatches.end()) historyBatches.push_back(ref);
+        } else if (m.middle[0][0] == '-' && open != historyBatches.end()) {
+            historyBatches.erase(open);
+        }
+    }
+    if (m.batch.size() && std::find(historyBatches.begin(), historyBatches.end(), m.batch) != historyBatches.end()) {
+        return replayed(m);
+    }
+    // registration replies, CAP negotiation, nick collisions and the held lines flushed on 001.
+    // Replies during registration skip pacing, the held lines flushed on 001 do not
+    std::string reply = session.offer(m);
+    if (reply.size()) send(reply, session.current != registration::REGISTERED);
+    if (settings.offer(m)) applySettings();
+    // back after a reconnect, CHATHISTORY is known from 005 by the end of the MOTD
+    if (reconnecting && (m.command == "376" || m.command == "422")) {
+        reconnecting = false;
+        retry.reset();
+        fetchMissed();
+    }
+    // watched nicks go on the new connection's MONITOR list, MONITOR is known from 005 by then
+    if (m.command == "376" || m.command == "422") {
+        std::vector<std::string> lines;
+        presence.resync(settings, lineRoom(), lines);
+        sendLines(lines);
+    }
+    // membership, before a pending names request takes the 353s
+    members.offer(m, session.nick);
+    // replies to our own refresh WHOs go no further
+    if (presence.offer(m, unixMs(), members, session.nick)) return;
+    if (log.isOpen()) {
+        std::string_view target = messageLog::targetOf(m, settings, session.nick);
+        // server-time when the server sends it, now otherwise
+        if (target.size()) log.append(target, m.msg, m.serverTime());
+    }
 
     /* If categorize flag is up, all messages will be save on messages list*/
     // if (!categorize) messages.push_back(m);
 
+    // LIST rows always go to the channel directory
+    bool listed = directory.offer(m);
+    // numerics someone asked for are collected into a single reply
+    if (requests.offer(m, nowMs()) || listed) return;
+
+    // the event buffer takes what would be queued for getNextMessage and getNextInfoMessage
+    if (events.enabled()) return events.push(m, (double)unixMs());
+
     // else will filter messages into different lists
     if (std::isdigit(m.command[0])) {
-        infoMessages.push_back(m);
+        infoMessages.push(std::move(m));
     } else if (m.command == "PRIVMSG") {
-        messages.push_back(m);
-    } else {
-        std::cout << "Uncaught categorization of message" << std::endl;
+        // once the UI subscribes, messages are kept per conversation and hidden ones only counted
+        if (conversations.active()) {
+            conversations.route(std::move(m), session.nick);
+        } else {
+            messages.push(std::move(m));
+        }
+    } else if (debug) {
+        std::printf("Uncaught categorization of message\n");
     }
 }
 
@@ -78,17 +969,103 @@ void ircController::die(std::string server) {
 }
 
 /**
- * @brief sends raw message to server
+ * @brief sends raw message to server, held until 001 while registration is in progress.
+ * PING, PONG and QUIT skip pacing, see setPacing
  * @note exported
  * @param msg
  */
 void ircController::sendMessage(std::string msg) {
-    if (debug) std::cout << "[DEBUG][sendMessage]: " << msg << std::endl;
-    emscripten_websocket_send_utf8_text(websocket, msg.c_str());
+    // a connection we close ourselves is not reopened
+    if (msg.compare(0, 4, "QUIT") == 0 && (msg.size() == 4 || msg[4] == ' ')) quitting = true;
+    // waiting to reconnect, kept for the next connection
+    if (reconnecting && session.current == registration::DISCONNECTED && !quitting) {
+        replay.push_back(std::move(msg));
+        return;
+    }
+    if (session.holds(msg)) {
+        if (debug) std::printf("[DEBUG][sendMessage][held]: %s\n", msg.c_str());
+        session.hold(std::move(msg));
+        return;
+    }
+    send(msg, priorityLine(msg));
+}
+
+/**
+ * @brief answers PING and times PONGs to our lag PINGs straight from the raw line
+ *
+ * @param line
+ * @return true if the line was handled and must not be categorized
+ */
+bool ircController::control(std::string_view line) {
+    // @tags and :prefix
+    while (line.size() && (line[0] == '@' || line[0] == ':')) {
+        size_t space = line.find(' ');
+        line = (space == std::string_view::npos) ? "" : line.substr(space + 1);
+    }
+    if (line.size() < 6 || line[4] != ' ') return false;
+    std::string_view command = line.substr(0, 4), params = line.substr(5);
+    if (command == "PING") {
+        pong(std::string(params));
+        return true;
+    }
+    if (command != "PONG") return false;
+    // <server> :<cookie>
+    size_t trailing = params.find(" :");
+    std::string_view cookie = trailing != std::string_view::npos ? params.substr(trailing + 2) : params.substr(params.rfind(' ') + 1);
+    if (cookie.size() && cookie[0] == ':') cookie.remove_prefix(1);
+    return lag.pong(cookie, nowMs());
+}
+
+/**
+ * @brief queues a frame and writes what pacing lets go
+ *
+ * @param frame
+ * @param priority PONG, PING, QUIT and registration replies, never held back by pacing
+ */
+void ircController::send(const std::string &frame, bool priority) {
+    outbound.push(frame, priority);
+    flushOutbound();
+}
+
+/**
+ * @brief writes queued lines that may go now as one frame, and schedules the next write if bulk lines are left
+ *
+ * @return size_t lines still queued
+ */
+size_t ircController::flushOutbound() {
+    std::string frame;
+    uint64_t now = nowMs();
+    if (outbound.next(frame, now)) sendFrame(frame);
+    uint64_t wait = outbound.wait(now);
+    // one timer at a time, a new one once the last has fired
+    if (wait && !drainTimer) {
+        drainTimer = timers.after(now, wait, [this]() {
+            drainTimer = 0;
+            flushOutbound();
+        });
+        armTimers();
+    }
+    return outbound.queued();
+}
+
+/**
+ * @brief writes one websocket frame, several lines are CRLF joined
+ *
+ * @param frame
+ */
+void ircController::sendFrame(const std::string &frame) {
+    if (debug) std::printf("[DEBUG][sendMessage]: %s\n", frame.c_str());
+#ifdef __EMSCRIPTEN__
+    emscripten_websocket_send_utf8_text(websocket, frame.c_str());
+#else
+    if (sink) sink(frame);
+#endif
 }
 
 /**
  * @brief Complete function that register user and nick on server
+ * Can be called right after openWebSocket, the registration burst goes out as soon as the socket opens
+ * and a taken nick is retried with a suffix, see getNick
  * @note exported
  * @note inspircd does not use hostname and servername
  * @note only the nick has to be unique
@@ -99,11 +1076,14 @@ void ircController::sendMessage(std::string msg) {
  * @param nick NICK
  */
 void ircController::registerUser(std::string username, std::string hostname, std::string servername, std::string realname, std::string nick) {
-    std::string msg = "USER ";
-    msg += username + " " + hostname + " " + servername + " " + realname;
-    sendMessage(msg);
-    msg = "NICK " + nick;
-    sendMessage(msg);
+    session.identify(username, hostname, servername, realname, nick);
+    if (session.current == registration::CONNECTING) return;
+    if (session.current == registration::OPEN) {
+        send(session.start(), true);
+        return;
+    }
+    sendMessage("USER " + username + " " + hostname + " " + servername + " :" + realname);
+    sendMessage("NICK " + nick);
 }
 
 /**
@@ -115,11 +1095,81 @@ std::string ircController::getNextMessage() {
     std::string retMsg = "";
     if (messages.size()) {
         retMsg = messages.front().asJson();
-        messages.erase(messages.begin());
+        messages.pop();
     }
     return retMsg;
 }
 
+/**
+ * @brief starts keeping PRIVMSGs of a channel or query for getTargetMessages.
+ * Once anything is subscribed PRIVMSGs no longer go to getNextMessage,
+ * targets that are not subscribed only count unread messages and mentions, see getUnreadCounts
+ * @note exported
+ * @param target channel or nick
+ * @return true
+ * @return false if empty or already subscribed
+ */
+bool ircController::subscribe(std::string target) {
+    return conversations.subscribe(target);
+}
+
+/**
+ * @brief stops keeping messages of a target, the ones not read yet are dropped
+ * @note exported
+ * @param target
+ * @return true
+ * @return false if it was not subscribed
+ */
+bool ircController::unsubscribe(std::string target) {
+    return conversations.unsubscribe(target);
+}
+
+/**
+ * @brief pops several messages of a subscribed target in one call
+ * @note exported
+ * @param target
+ * @param max
+ * @return std::string json array of messages, "[]" if none
+ */
+std::string ircController::getTargetMessages(std::string target, int max) {
+    return conversations.next(target, max > 0 ? max : 0);
+}
+
+/**
+ * @brief pops several messages of a subscribed target as one HTML fragment, for a single insertAdjacentHTML.
+ * mIRC formatting becomes spans, text is escaped and links are anchors
+ * @note exported
+ * @param target
+ * @param max
+ * @return std::string a <p> per message, empty if none
+ */
+std::string ircController::renderTargetMessages(std::string target, int max) {
+    html.clear();
+    conversations.render(target, max > 0 ? max : 0, session.nick, html);
+    return html.html();
+}
+
+/**
+ * @brief renders a line we just sent the way renderTargetMessages would
+ * @note exported
+ * @param text
+ * @return std::string
+ */
+std::string ircController::renderOwnMessage(std::string text) {
+    html.clear();
+    html.line(session.nick, text, true);
+    return html.html();
+}
+
+/**
+ * @brief unread and mention counters of targets that are not subscribed
+ * @note exported
+ * @return std::string json {"<target>": {"unread", "mentions"}}
+ */
+std::string ircController::getUnreadCounts() {
+    return conversations.unreadCounts();
+}
+
 /**
  * @brief return next message on info messages vector as json
  *
@@ -129,11 +1179,35 @@ std::string ircController::getNextInfoMessage() {
     std::string retMsg = "";
     if (infoMessages.size()) {
         retMsg = infoMessages.front().asJson();
-        infoMessages.erase(infoMessages.end());
+        infoMessages.pop();
     }
     return retMsg;
 }
 
+/**
+ * @brief return next aggregated reply to whois, names, who, motd, list, stats or lusers as json
+ * {"id": handle returned by the request, "type", "ok", "error", "truncated", "result"}
+ * @note exported
+ * @return std::string empty if no request has completed
+ */
+std::string ircController::getNextReply() {
+    return requests.nextResult();
+}
+
+/**
+ * @brief returns one page of the channel directory filled by LIST, usable while rows are still arriving
+ * @note exported
+ * @param filter case insensitive substring of name or topic, or a glob on the name if it has '*' or '?'
+ * @param sort "users" (most first) or "name"
+ * @param offset
+ * @param count
+ * @return std::string json {"total", "matched", "complete", "offset", "channels": [{"name", "users", "topic"}]}
+ */
+std::string ircController::getListPage(std::string filter, std::string sort, int offset, int count) {
+    if (offset < 0 || count < 0) return "";
+    return directory.getPage(filter, sort, offset, count);
+}
+
 /**
  * @brief Requests the contact details for the administrator of the specified server.
  * If <server> is not specified then it defaults to the local server.
@@ -177,18 +1251,7 @@ void ircController::commands() {
  * @return false if userAThost is empty or duration is given without a reason or vice versa
  */
 bool ircController::eline(std::vector<std::string> userAThost, std::string duration, std::string reason) {
-    if (!userAThost.size() || (duration != reason && (duration != "" || reason != ""))) return false;
-    std::string msg = "ELINE ";
-    for (auto it = userAThost.begin(); it != userAThost.end(); it++) {
-        if (it != userAThost.begin()) msg += ",";
-        msg += (*it);
-    }
-    if (duration != "")
-        msg += " " + duration + " " + reason;
-
-    sendMessage(msg);
-
-    return true;
+    return xline("ELINE", views(userAThost), duration, reason);
 }
 
 /**
@@ -204,18 +1267,7 @@ bool ircController::eline(std::vector<std::string> userAThost, std::string durat
  * @return false if userAThost is empty or duration is given without a reason or vice versa
  */
 bool ircController::gline(std::vector<std::string> userAThost, std::string duration, std::string reason) {
-    if (!userAThost.size() || (duration != reason && (duration != "" || reason != ""))) return false;
-    std::string msg = "GLINE ";
-    for (auto it = userAThost.begin(); it != userAThost.end(); it++) {
-        if (it != userAThost.begin()) msg += ",";
-        msg += (*it);
-    }
-    if (duration != "")
-        msg += " " + duration + " " + reason;
-
-    sendMessage(msg);
-
-    return true;
+    return xline("GLINE", views(userAThost), duration, reason);
 }
 
 /**
@@ -258,13 +1310,7 @@ bool ircController::invite(std::string nick, std::string chan, std::string durat
  * @return false if nick vector is empty
  */
 bool ircController::ison(std::vector<std::string> nick) {
-    if (!nick.size()) return false;
-    std::string msg = "ISON ";
-    for (auto it = nick.begin(); it != nick.end(); it++) {
-        if (it != nick.begin()) msg += " ";
-        msg += (*it);
-    }
-    return true;
+    return isonList(views(nick));
 }
 
 /**
@@ -273,26 +1319,10 @@ bool ircController::ison(std::vector<std::string> nick) {
  * @param chans channels to join
  * @param keys keys to use
  * @return true
- * @return false if keys size is not zero and chans and keys are different sizes
+ * @return false if keys size is not zero and chans and keys are different sizes or the channels budget is reached
  */
 bool ircController::join(std::vector<std::string> chans, std::vector<std::string> keys) {
-    if (keys.size() != 0 && chans.size() != keys.size()) return false;
-
-    std::string msg = "JOIN ";
-
-    for (auto it = chans.begin(); it != chans.end(); it++) {
-        if (it != chans.begin()) msg += ",";
-        msg += (*it);
-        channels.push_back(*it);
-    }
-    msg += " ";
-
-    for (auto it = keys.begin(); it != keys.end(); it++) {
-        if (it != keys.begin()) msg += ",";
-        msg += (*it);
-    }
-    sendMessage(msg);
-    return true;
+    return joinList(views(chans), views(keys));
 }
 
 /**
@@ -306,17 +1336,7 @@ bool ircController::join(std::vector<std::string> chans, std::vector<std::string
  * @return false if no channel name is provided or nicks vector is empty
  */
 bool ircController::kick(std::string chan, std::vector<std::string> nicks, std::string reason) {
-    if (!chan.size() || !nicks.size()) return false;
-    std::string msg = "KICK " + chan + " ";
-
-    for (auto it = nicks.begin(); it != nicks.end(); it++) {
-        if (it != nicks.begin()) msg += ",";
-        msg += (*it);
-    }
-
-    if (reason != "") msg += " " + reason;
-
-    return true;
+    return kickList(chan, views(nicks), reason);
 }
 
 /**
@@ -328,17 +1348,7 @@ bool ircController::kick(std::string chan, std::vector<std::string> nicks, std::
  * @return false if nicks vector is empty
  */
 bool ircController::kill(std::vector<std::string> nicks, std::string reason) {
-    if (!nicks.size()) return false;
-    std::string msg = "KILL ";
-
-    for (auto it = nicks.begin(); it != nicks.end(); it++) {
-        if (it != nicks.begin()) msg += ",";
-        msg += (*it);
-    }
-
-    if (reason != "") msg += " " + reason;
-
-    return true;
+    return killList(views(nicks), reason);
 }
 
 /**
@@ -354,37 +1364,25 @@ bool ircController::kill(std::vector<std::string> nicks, std::string reason) {
  * @return false if userAThost is empty or duration is given without a reason or vice versa
  */
 bool ircController::kline(std::vector<std::string> userAThost, std::string duration, std::string reason) {
-    if (!userAThost.size() || (duration != reason && (duration != "" || reason != ""))) return false;
-    std::string msg = "GLINE ";
-    for (auto it = userAThost.begin(); it != userAThost.end(); it++) {
-        if (it != userAThost.begin()) msg += ",";
-        msg += (*it);
-    }
-    if (duration != "")
-        msg += " " + duration + " " + reason;
-
-    sendMessage(msg);
-
-    return true;
+    return xline("KLINE", views(userAThost), duration, reason);
 }
 
 /// LIST [ (>|<)<count> | C(>|<)<minutes> | T(>|<)<minutes> | [!]<pattern>]+
 /**
  * @brief Lists all channels visible to the requesting user which match the specified criteria. If no criteria is specified then all visible channels are listed.
  *
- * @return true
- * @return false
+ * Rows are streamed into the channel directory, read them with getListPage,
+ * the aggregated reply only carries their count
+ *
+ * @param patterns space separated criteria, may be empty
+ * @return int handle of the aggregated reply, see getNextReply
  */
-bool ircController::list(std::string patterns) {
-    if (!patterns.size()) return false;
-
-    std::string msg = "LIST ";
-    for (auto it = patterns.begin(); it != patterns.end(); it++) {
-        if (it != patterns.begin()) msg += " ";
-        msg += (*it);
-    }
+int ircController::list(std::string patterns) {
+    std::string msg = (!patterns.size()) ? "LIST" : "LIST " + patterns;
+    directory.reset();
+    int handle = track(requestTracker::LIST);
     sendMessage(msg);
-    return true;
+    return handle;
 }
 
 /**
@@ -404,9 +1402,12 @@ bool ircController::loadmodule(std::string module) {
 /**
  * @brief Requests information about the current and total number of servers, server operators, and users.
  *
+ * @return int handle of the aggregated reply, see getNextReply
  */
-void ircController::lusers() {
+int ircController::lusers() {
+    int handle = track(requestTracker::LUSERS);
     sendMessage("LUSERS");
+    return handle;
 }
 
 /**
@@ -421,15 +1422,31 @@ void ircController::lusers() {
  */
 /// MODE <channel>|<user> <modes> [<parameters>]+
 bool ircController::mode(std::string target, std::string modes, std::vector<std::string> params) {
-    if (!target.size() || !modes.size()) return false;
+    return modeList(target, modes, views(params));
+}
 
-    std::string msg = "MODE " + target + " " + modes + " ";
-    for (auto it = params.begin(); it != params.end(); it++) {
-        if (it != params.begin()) msg += " ";
-        msg += (*it);
-    }
-    sendMessage(msg);
-    return true;
+/**
+ * @brief follows nicks coming online and going offline, see getPresence.
+ * Sent as MONITOR + when the server offers MONITOR and has room on its list, otherwise the nicks are refreshed
+ * with WHOX every round of setPresenceRefresh. Kept across reconnects
+ * @note exported
+ * @param nicks
+ * @return true
+ * @return false if nicks is empty
+ */
+bool ircController::monitor(std::vector<std::string> nicks) {
+    return monitorList(views(nicks), true);
+}
+
+/**
+ * @brief stops following nicks, see monitor
+ * @note exported
+ * @param nicks
+ * @return true
+ * @return false if nicks is empty
+ */
+bool ircController::unmonitor(std::vector<std::string> nicks) {
+    return monitorList(views(nicks), false);
 }
 
 /**
@@ -444,25 +1461,23 @@ void ircController::modules() {
  * Otherwise, requests the message of the day for the local server.
  *
  * @param server
+ * @return int handle of the aggregated reply, see getNextReply
  */
-void ircController::motd(std::string server) {
+int ircController::motd(std::string server) {
     std::string msg = (!server.size()) ? "MOTD" : "MOTD " + server;
+    int handle = track(requestTracker::MOTD);
     sendMessage(msg);
+    return handle;
 }
 
 /**
  * @brief asks server for list of nicknames on given channel array
  *
  * @param chans
+ * @return int handle of the aggregated reply, see getNextReply
  */
-void ircController::names(std::vector<std::string> chans) {
-    std::string msg = "NAMES ";
-
-    for (auto it = chans.begin(); it != chans.end(); it++) {
-        if (it != chans.begin()) msg += ",";
-        msg += (*it);
-    }
-    sendMessage(msg);
+int ircController::names(std::vector<std::string> chans) {
+    return namesList(views(chans));
 }
 
 /**
@@ -490,15 +1505,7 @@ bool ircController::nick(std::string nickname) {
  * @return false
  */
 bool ircController::notice(std::vector<std::string> targets, std::string message) {
-    if (!targets.size() || !message.size()) return false;
-    std::string msg = "NOTICE ";
-    for (auto it = targets.begin(); it != targets.end(); it++) {
-        if (it != targets.begin()) msg += ",";
-        msg += (*it);
-    }
-    msg += " " + message;
-    sendMessage(msg);
-    return true;
+    return noticeList(views(targets), message);
 }
 
 /**
@@ -525,6 +1532,11 @@ bool ircController::oper(std::string name, std::string pass) {
  */
 bool ircController::pass(std::string pass) {
     if (!pass.size()) return false;
+    // before registration it becomes part of the burst, PASS has to come first
+    if (session.current == registration::CONNECTING || session.current == registration::OPEN) {
+        session.setPassword(pass);
+        return true;
+    }
     sendMessage("PASS " + pass);
     return true;
 }
@@ -538,24 +1550,7 @@ bool ircController::pass(std::string pass) {
  * @return false if channel array size is zero
  */
 bool ircController::part(std::vector<std::string> chans, std::string reason) {
-    if (!channels.size()) return false;
-    std::string msg = "PART ";
-
-    for (auto it = chans.begin(); it != chans.end(); it++) {
-        if (it != chans.begin()) msg += ",";
-        msg += (*it);
-        unsigned int pos = 0;
-        for (auto jt = chans.begin(); jt != chans.end(); jt++) {
-            if (*it == *jt)
-                channels.erase(channels.begin() + pos);
-            pos++;
-        }
-    }
-    if (reason != "")
-        msg += " :" + reason;
-
-    sendMessage(msg);
-    return true;
+    return partList(views(chans), reason);
 }
 
 /**
@@ -579,23 +1574,18 @@ bool ircController::ping(std::string cookie, std::string server) {
  * @param daemon server
  */
 void ircController::pong(std::string daemon) {
-    std::string msg = "PONG " + daemon;
-    sendMessage(msg);
+    sendMessage("PONG " + daemon);
 }
 
 /**
- * @brief sends message to all connected channels
+ * @brief sends message to all connected channels, in as many lines as the server's target and line limits require
  *
  * @param text
  */
 void ircController::privmsg(std::string text) {
-    std::string msg = "PRIVMSG ";
-    for (auto it = channels.begin(); it != channels.end(); it++) {
-        if (it != channels.begin()) msg += ",";
-        msg += (*it);
-    }
-    msg += " :" + text;
-    sendMessage(msg);
+    argList targets;
+    for (auto it = channels.begin(); it != channels.end(); it++) targets.push_back(pool.view(*it));
+    sendTargeted("PRIVMSG", "", targets, text, true);
 }
 
 /**
@@ -611,18 +1601,7 @@ void ircController::privmsg(std::string text) {
  * @return false if nicks is empty or duration is given without a reason or vice versa
  */
 bool ircController::qline(std::vector<std::string> nicks, std::string duration, std::string reason) {
-    if (!nicks.size() || (duration != reason && (duration != "" || reason != ""))) return false;
-    std::string msg = "QLINE ";
-    for (auto it = nicks.begin(); it != nicks.end(); it++) {
-        if (it != nicks.begin()) msg += ",";
-        msg += (*it);
-    }
-    if (duration != "")
-        msg += " " + duration + " " + reason;
-
-    sendMessage(msg);
-
-    return true;
+    return xline("QLINE", views(nicks), duration, reason);
 }
 
 /**
@@ -721,14 +1700,15 @@ bool ircController::squery(std::string target, std::string message) {
  *
  * @param character single character
  * @param server [optional] server to request
- * @return true
- * @return false
+ * @return int handle of the aggregated reply, see getNextReply
+ * @return 0 if character is not a single character
  */
-bool ircController::stats(std::string character, std::string server) {
-    if (character.size() != 1) return false;
+int ircController::stats(std::string character, std::string server) {
+    if (character.size() != 1) return 0;
     std::string msg = (server.size() == 0) ? "STATS " + character : "STATS " + character + " " + server;
+    int handle = track(requestTracker::STATS);
     sendMessage(msg);
-    return true;
+    return handle;
 }
 
 /**
@@ -801,14 +1781,7 @@ bool ircController::user(std::string username, std::string hostname, std::string
  * @return false
  */
 bool ircController::userhost(std::vector<std::string> nicks) {
-    if (!nicks.size()) return true;
-    std::string msg = "USERHOST ";
-    for (auto it = nicks.begin(); it != nicks.end(); it++) {
-        if (it != nicks.begin()) msg += " ";
-        msg += (*it);
-    }
-    sendMessage(msg);
-    return false;
+    return userhostList(views(nicks));
 }
 
 /**
@@ -846,23 +1819,23 @@ bool ircController::wallops(std::string message) {
  * @param flags
  * @param fields
  * @param queryType
- * @param pattern_e
- * @return true
- * @return false
+ * @param pattern_e [optional]
+ * @return int handle of the aggregated reply, see getNextReply
+ * @return 0 if pattern_s is empty or queryType is given without fields
  */
-bool ircController::who(std::string pattern_s, std::string flags, std::string fields, std::string queryType, std::string pattern_e) {
-    if ((!pattern_s.size() || !pattern_e.size()) ||
-        !fields.size() && queryType.size())
-        return false;
+int ircController::who(std::string pattern_s, std::string flags, std::string fields, std::string queryType, std::string pattern_e) {
+    if (!pattern_s.size() || (!fields.size() && queryType.size()))
+        return 0;
 
     std::string msg = "WHO " + pattern_s;
-    msg = (flags.size()) ? msg + " " + flags : msg;
+    if (flags.size() || fields.size()) msg += " " + flags;
     msg = (fields.size()) ? msg + "%" + fields : msg;
     msg = (queryType.size()) ? msg + "," + queryType : msg;
-    msg += pattern_e;
+    msg = (pattern_e.size()) ? msg + " " + pattern_e : msg;
 
+    int handle = track(requestTracker::WHO);
     sendMessage(msg);
-    return true;
+    return handle;
 }
 /**
  * @briefRequests information about users who are currently connected with the specified nicks:
@@ -871,19 +1844,11 @@ bool ircController::who(std::string pattern_s, std::string flags, std::string fi
  *
  * @param server
  * @param nicks
- * @return true
- * @return false
+ * @return int handle of the aggregated reply, see getNextReply
+ * @return 0 if nicks is empty or more than one nick is given with a server
  */
-bool ircController::whois(std::string server, std::vector<std::string> nicks) {
-    if (!nicks.size()) return false;
-
-    std::string msg = (server.size()) ? "WHOIS " + server : "WHO";
-    for (auto it = nicks.begin(); it != nicks.end(); it++) {
-        if (it != nicks.begin()) msg += ",";
-        msg += (*it);
-    }
-
-    return true;
+int ircController::whois(std::string server, std::vector<std::string> nicks) {
+    return whoisList(server, views(nicks));
 }
 
 /**
@@ -901,16 +1866,380 @@ bool ircController::whowas(std::string nick, std::string count) {
 }
 
 bool ircController::zline(std::vector<std::string> ipaddr, std::string duration, std::string reason) {
-    if (!ipaddr.size() || (duration != reason && (duration != "" || reason != ""))) return false;
-    std::string msg = "ZLINE ";
-    for (auto it = ipaddr.begin(); it != ipaddr.end(); it++) {
-        if (it != ipaddr.begin()) msg += ",";
-        msg += (*it);
+    return xline("ZLINE", views(ipaddr), duration, reason);
+}
+
+/**
+ * @brief returns a buffer of at least size bytes owned by the controller, reused between calls,
+ * for bulkView to read its list from
+ *
+ * @param size
+ * @return char*
+ */
+char *ircController::reserveArgs(size_t size) {
+    if (argBuffer.size() < size) argBuffer.resize(size);
+    return &argBuffer[0];
+}
+
+/**
+ * @brief feeds a frame as if it came from the socket, for bridges that own the transport and for benchmarks
+ * @note exported
+ * @param frame one or more CRLF terminated lines
+ */
+void ircController::receive(std::string frame) {
+    ingest(frame.data(), frame.size());
+}
+
+#if defined(__EMSCRIPTEN__) && !defined(IRC_CAPI)
+/**
+ * @brief Uint8Array view of wasm memory to write a delimited list into for bulkView.
+ * The view is detached if memory grows, take a fresh one for every call
+ * @note exported
+ * @param size
+ * @return emscripten::val
+ */
+emscripten::val ircController::getArgBuffer(int size) {
+    if (size < 0) size = 0;
+    return emscripten::val(emscripten::typed_memory_view((size_t)size, (unsigned char *)reserveArgs(size)));
+}
+
+/**
+ * @brief typed array views of the event buffer columns.
+ * Events oldest to commit - 1 of header (Int32Array, commit, oldest, generation, capacity, textBytes) are
+ * readable in slot n & (capacity - 1), their text is text.subarray(textOffset, textOffset + textLength).
+ * Counters wrap, compare them as (a - b) | 0. Views detach when memory grows, take new ones then
+ * @note exported
+ * @return emscripten::val {header, command, sender, target, textOffset, textLength: Int32Array, time: Float64Array, text: Uint8Array}
+ */
+emscripten::val ircController::getEventViews() {
+    emscripten::val views = emscripten::val::object();
+    views.set("header", emscripten::typed_memory_view(events.header.size(), events.header.data()));
+    views.set("command", emscripten::typed_memory_view(events.commands.size(), events.commands.data()));
+    views.set("sender", emscripten::typed_memory_view(events.senders.size(), events.senders.data()));
+    views.set("target", emscripten::typed_memory_view(events.targets.size(), events.targets.data()));
+    views.set("time", emscripten::typed_memory_view(events.times.size(), events.times.data()));
+    views.set("textOffset", emscripten::typed_memory_view(events.textOffsets.size(), events.textOffsets.data()));
+    views.set("textLength", emscripten::typed_memory_view(events.textLengths.size(), events.textLengths.data()));
+    views.set("text", emscripten::typed_memory_view(events.text.size(), (unsigned char *)events.text.data()));
+    return views;
+}
+#endif
+
+/**
+ * @brief runs a list command with its list given as one delimited string.
+ * Crosses the embind boundary once instead of once per element, items are parsed in place
+ * and separated by '\n', ',' or ' '
+ * @note exported
+ * @param command JOIN (arg1 keys list), PART (arg1 reason), NAMES, KICK (arg1 channel, arg2 reason),
+ * KILL (arg1 reason), ELINE/GLINE/KLINE/ZLINE/QLINE (arg1 duration, arg2 reason), ISON, USERHOST,
+ * NOTICE (arg1 text), WHOIS (arg1 server), MODE (arg1 target, arg2 modes; list holds the parameters)
+ * @param list
+ * @param arg1
+ * @param arg2
+ * @return int what the vector variant returns, booleans as 1/0
+ */
+int ircController::bulk(std::string command, std::string list, std::string arg1, std::string arg2) {
+    return runBulk(command, list, arg1, arg2);
+}
+
+/**
+ * @brief like bulk, with the list read from the first len bytes of the buffer returned by getArgBuffer,
+ * so it is never copied out of wasm memory
+ * @note exported
+ * @param command
+ * @param len
+ * @param arg1
+ * @param arg2
+ * @return int
+ */
+int ircController::bulkView(std::string command, int len, std::string arg1, std::string arg2) {
+    if (len < 0 || (size_t)len > argBuffer.size()) return 0;
+    return runBulk(command, std::string_view(argBuffer.data(), len), arg1, arg2);
+}
+
+int ircController::runBulk(std::string_view command, std::string_view list, std::string arg1, std::string arg2) {
+    argList items;
+    splitArgs(list, items);
+    if (command == "JOIN") {
+        argList keys;
+        splitArgs(arg1, keys);
+        return joinList(items, keys);
     }
+    if (command == "PART") return partList(items, arg1);
+    if (command == "NAMES") return namesList(items);
+    if (command == "KICK") return kickList(arg1, items, arg2);
+    if (command == "KILL") return killList(items, arg1);
+    if (command == "ELINE" || command == "GLINE" || command == "KLINE" || command == "ZLINE" || command == "QLINE")
+        return xline(std::string(command).c_str(), items, arg1, arg2);
+    if (command == "ISON") return isonList(items);
+    if (command == "USERHOST") return userhostList(items);
+    if (command == "NOTICE") return noticeList(items, arg1);
+    if (command == "WHOIS") return whoisList(arg1, items);
+    if (command == "MODE") return modeList(arg1, arg2, items);
+    return 0;
+}
+
+/**
+ * @brief shared by eline, gline, kline, zline and qline
+ *
+ * @param command
+ * @param masks
+ * @param duration
+ * @param reason
+ * @return true
+ * @return false if masks is empty or duration is given without a reason or vice versa
+ */
+bool ircController::xline(const char *command, const argList &masks, std::string duration, std::string reason) {
+    if (!masks.size() || duration.empty() != reason.empty()) return false;
+    std::string msg = std::string(command) + " ";
+    appendJoined(msg, masks, ',');
     if (duration != "")
-        msg += " " + duration + " " + reason;
+        msg += " " + duration + " :" + reason;
+
+    sendMessage(msg);
+
+    return true;
+}
+
+bool ircController::isonList(const argList &nicks) {
+    if (!nicks.size()) return false;
+    std::string msg = "ISON ";
+    appendJoined(msg, nicks, ' ');
+    sendMessage(msg);
+    return true;
+}
+
+bool ircController::joinList(const argList &chans, const argList &keys) {
+    if (keys.size() != 0 && chans.size() != keys.size()) return false;
+    if (channelStats.budget && heapBytes(channels) + chans.size() * sizeof(uint32_t) > channelStats.budget) {
+        channelStats.evicted += chans.size();
+        return false;
+    }
+
+    for (auto it = chans.begin(); it != chans.end(); it++) {
+        uint32_t id = pool.find(*it);
+        if (!id || std::find(channels.begin(), channels.end(), id) == channels.end()) channels.push_back(id = pool.intern(*it));
+        // kept to join again after a reconnect
+        if (keys.size() && keys[it - chans.begin()].size()) channelKeys[id] = std::string(keys[it - chans.begin()]);
+    }
+    revision++;
+    bool keyed = false;
+    for (auto it = keys.begin(); it != keys.end(); it++) keyed = keyed || it->size();
+
+    // channels and their keys are split together
+    size_t max = settings.maxTargets("JOIN"), room = lineRoom();
+    for (size_t i = 0; i < chans.size();) {
+        argList batch, batchKeys;
+        size_t bytes = 5;
+        while (i < chans.size() && (!max || batch.size() < max)) {
+            size_t add = chans[i].size() + 1 + (keyed ? keys[i].size() + 1 : 0);
+            if (batch.size() && bytes + add > room) break;
+            bytes += add;
+            batch.push_back(chans[i]);
+            if (keyed) batchKeys.push_back(keys[i]);
+            i++;
+        }
+        std::string msg = "JOIN ";
+        appendJoined(msg, batch, ',');
+        if (keyed) {
+            msg += " ";
+            appendJoined(msg, batchKeys, ',');
+        }
+        sendMessage(msg);
+    }
+    return true;
+}
+
+bool ircController::kickList(std::string chan, const argList &nicks, std::string reason) {
+    if (!chan.size() || !nicks.size()) return false;
+    return sendTargeted("KICK", chan, nicks, reason, false);
+}
 
+bool ircController::killList(const argList &nicks, std::string reason) {
+    if (!nicks.size()) return false;
+    std::string msg = "KILL ";
+    appendJoined(msg, nicks, ',');
+    if (reason != "") msg += " :" + reason;
+    sendMessage(msg);
+    return true;
+}
+
+bool ircController::modeList(std::string target, std::string modes, const argList &params) {
+    if (!target.size() || !modes.size()) return false;
+    std::string msg = "MODE " + target + " " + modes + " ";
+    appendJoined(msg, params, ' ');
+    sendMessage(msg);
+    return true;
+}
+
+bool ircController::monitorList(const argList &nicks, bool add) {
+    if (!nicks.size()) return false;
+    std::vector<std::string> lines;
+    // before registration the list goes out at the end of the MOTD
+    presence.watch(nicks, add, session.current == registration::REGISTERED, settings, lineRoom(), lines);
+    sendLines(lines);
+    return true;
+}
+
+// several lines as one paced frame
+void ircController::sendLines(const std::vector<std::string> &lines) {
+    std::string frame;
+    for (auto it = lines.begin(); it != lines.end(); it++) {
+        if (frame.size()) frame += "\r\n";
+        frame += *it;
+    }
+    if (frame.size()) send(frame, false);
+}
+
+int ircController::namesList(const argList &chans) {
+    int handle = track(requestTracker::NAMES, std::vector<std::string>(chans.begin(), chans.end()));
+    if (chans.empty()) {
+        sendMessage("NAMES");
+    } else {
+        sendTargeted("NAMES", "", chans, "", false);
+    }
+    return handle;
+}
+
+bool ircController::noticeList(const argList &targets, std::string message) {
+    if (!targets.size() || !message.size()) return false;
+    return sendTargeted("NOTICE", "", targets, message, true);
+}
+
+bool ircController::partList(const argList &chans, std::string reason) {
+    if (!chans.size() || !sendTargeted("PART", "", chans, reason, false)) return false;
+    for (auto it = chans.begin(); it != chans.end(); it++) {
+        auto found = std::find(channels.begin(), channels.end(), pool.find(*it));
+        if (found == channels.end()) continue;
+        channelKeys.erase(*found);
+        pool.release(*found);
+        channels.erase(found);
+        revision++;
+    }
+    return true;
+}
+
+bool ircController::userhostList(const argList &nicks) {
+    if (!nicks.size()) return false;
+    std::string msg = "USERHOST ";
+    appendJoined(msg, nicks, ' ');
     sendMessage(msg);
+    return true;
+}
+
+int ircController::whoisList(std::string server, const argList &nicks) {
+    if (!nicks.size() || (server.size() && nicks.size() > 1)) return 0;
+    int handle = track(requestTracker::WHOIS, std::vector<std::string>(nicks.begin(), nicks.end()));
+    sendTargeted("WHOIS", server, nicks, "", false);
+    return handle;
+}
+
+// bytes a line may take before its CRLF
+size_t ircController::lineRoom() {
+    return settings.lineLen > 64 ? settings.lineLen - 2 : 510;
+}
+
+/**
+ * @brief bytes the server puts in front of a line it relays from us, ":nick!user@host ".
+ * User and host are the ones seen on our own JOIN or 396, the longest the server allows until then
+ *
+ * @return size_t
+ */
+size_t ircController::echoOverhead() {
+    size_t user = session.user.size() ? session.user.size() : 10;
+    size_t host = session.host.size() ? session.host.size() : 63;
+    return 1 + session.nick.size() + 1 + user + 1 + host + 1;
+}
+
+/**
+ * @brief sends a command carrying a comma separated target list as one write, in as many lines as
+ * MAXTARGETS/TARGMAX and LINELEN require. A text is sized so that both our line and the copy the server relays
+ * to each target with our prefix in front fit, it is cut once and every piece goes to every batch of targets
+ *
+ * @param command
+ * @param leading parameter before the targets (KICK channel, WHOIS server), may be empty
+ * @param targets
+ * @param text trailing parameter, may be empty
+ * @param split true to send a text too long for one line in pieces (PRIVMSG, NOTICE), false to cut it (PART, KICK reasons)
+ * @return false if nothing was sent, the text was only line breaks
+ */
+bool ircController::sendTargeted(std::string_view command, std::string_view leading, const argList &targets, std::string_view text, bool split) {
+    size_t max = settings.maxTargets(command), room = lineRoom();
+    std::string head(command);
+    head += " ";
+    if (leading.size()) head.append(leading.data(), leading.size()).append(" ");
+    // targets may not crowd a text out of the line, it keeps up to half of it
+    size_t reserve = text.size() ? std::min(text.size(), room / 2) + 2 : 0;
+
+    std::vector<std::string> heads;
+    size_t longest = 0;
+    for (size_t i = 0; i < targets.size();) {
+        std::string line = head;
+        size_t count = 0;
+        while (i < targets.size() && (!max || count < max)) {
+            if (count && line.size() + 1 + targets[i].size() + reserve > room) break;
+            if (count) line += ",";
+            line.append(targets[i].data(), targets[i].size());
+            longest = std::max(longest, targets[i].size());
+            count++;
+            i++;
+        }
+        heads.push_back(line);
+    }
+
+    argList pieces;
+    if (text.size()) {
+        size_t fit = room;
+        for (auto it = heads.begin(); it != heads.end(); it++) fit = std::min(fit, room > it->size() + 2 ? room - it->size() - 2 : 0);
+        size_t relayed = echoOverhead() + head.size() + longest + 2;
+        fit = std::min(fit, room > relayed ? room - relayed : 0);
+        splitText(text, fit, pieces);
+        if (!split && pieces.size() > 1) pieces.resize(1);
+        // sent without it, a PRIVMSG or NOTICE would be a bare command the server rejects
+        if (pieces.empty()) return false;
+    }
 
+    std::string frame;
+    for (auto it = heads.begin(); it != heads.end(); it++) {
+        if (pieces.empty()) {
+            if (frame.size()) frame += "\r\n";
+            frame += *it;
+            continue;
+        }
+        for (auto piece = pieces.begin(); piece != pieces.end(); piece++) {
+            if (frame.size()) frame += "\r\n";
+            frame.append(*it).append(" :").append(piece->data(), piece->size());
+        }
+    }
+    if (frame.size()) sendMessage(frame);
+    if (command == "PRIVMSG" || command == "NOTICE") logSent(command, targets, pieces);
     return true;
 }
+
+/**
+ * @brief files what we said in the message log as the line others see, with our prefix in front.
+ * With echo-message the server sends them back and they are logged as they arrive instead
+ *
+ * @param command
+ * @param targets
+ * @param pieces text as it was split into lines
+ */
+void ircController::logSent(std::string_view command, const argList &targets, const argList &pieces) {
+    if (!log.isOpen() || session.enabled("echo-message")) return;
+    std::string prefix = ":" + session.nick;
+    if (session.user.size()) prefix += "!" + session.user;
+    if (session.host.size()) prefix += "@" + session.host;
+    prefix += " ";
+    prefix.append(command.data(), command.size()).append(" ");
+    message m("");
+    std::string line;
+    for (auto target = targets.begin(); target != targets.end(); target++) {
+        for (auto piece = pieces.begin(); piece != pieces.end(); piece++) {
+            line = prefix;
+            line.append(target->data(), target->size()).append(" :").append(piece->data(), piece->size());
+            m.parse(line);
+            std::string_view filed = messageLog::targetOf(m, settings, session.nick);
+            if (filed.size()) log.append(filed, m.msg);
+        }
+    }
+}
@@ -0,0 +1,226 @@
+#include "../include/isupport.hpp"
+
+#include <cctype>
+#include <cstdlib>
+
+static const char *mappingNames[] = {"ascii", "rfc1459", "strict-rfc1459"};
+
+// 256 entry folding tables, built once.
+// ascii folds A-Z, strict-rfc1459 also []\ onto {}| and rfc1459 also ^ onto ~
+static const unsigned char *buildTable(isupport::casemapping mapping) {
+    static unsigned char tables[3][256];
+    static bool built = false;
+    if (!built) {
+        for (int t = 0; t < 3; t++) {
+            for (int c = 0; c < 256; c++) tables[t][c] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+        }
+        for (int t = isupport::RFC1459; t <= isupport::STRICT_RFC1459; t++) {
+            tables[t]['['] = '{';
+            tables[t][']'] = '}';
+            tables[t]['\\'] = '|';
+        }
+        tables[isupport::RFC1459]['^'] = '~';
+        built = true;
+    }
+    return tables[mapping];
+}
+
+// 005 values escape spaces and other bytes as \xHH
+static std::string unescape(const std::string &value) {
+    std::string ret;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '\\' && i + 3 < value.size() && value[i + 1] == 'x' && std::isxdigit((unsigned char)value[i + 2]) &&
+            std::isxdigit((unsigned char)value[i + 3])) {
+            ret += (char)std::strtol(value.substr(i + 2, 2).c_str(), nullptr, 16);
+            i += 3;
+        } else {
+            ret += value[i];
+        }
+    }
+    return ret;
+}
+
+static size_t number(const std::string &value, size_t fallback) {
+    if (value.empty()) return fallback;
+    return std::strtoul(value.c_str(), nullptr, 10);
+}
+
+isupport::isupport() {
+    reset();
+}
+
+/**
+ * @brief takes 005 lines, every one of them adds to or overrides what is known
+ *
+ * @param m
+ * @return true if it was a 005
+ * @return false otherwise
+ */
+bool isupport::offer(message &m) {
+    if (m.command != "005") return false;
+    // <me> TOKEN[=value] ... :are supported by this server
+    for (size_t i = 1; i < m.middle.size(); i++) {
+        const std::string &token = m.middle[i];
+        bool negated = token.size() && token[0] == '-';
+        size_t eq = token.find('=');
+        std::string key = token.substr(negated ? 1 : 0, eq == std::string::npos ? std::string::npos : eq - (negated ? 1 : 0));
+        std::string value = eq == std::string::npos ? "" : unescape(token.substr(eq + 1));
+        if (key.empty()) continue;
+        if (negated) {
+            tokens.erase(key);
+        } else {
+            tokens[key] = value;
+        }
+        apply(key, value, negated);
+    }
+    return true;
+}
+
+/**
+ * @brief back to defaults, for a new connection
+ */
+void isupport::reset() {
+    mapping = RFC1459;
+    chantypes = "#&";
+    prefixModes = "ov";
+    prefixSymbols = "@+";
+    maxTargetsDefault = 0;
+    targmax.clear();
+    lineLen = 512;
+    nickLen = 9;
+    channelLen = 200;
+    topicLen = 0;
+    network.clear();
+    tokens.clear();
+}
+
+const unsigned char *isupport::foldTable() const {
+    return buildTable(mapping);
+}
+
+const unsigned char *isupport::foldTable(casemapping mapping) {
+    return buildTable(mapping);
+}
+
+/**
+ * @brief how many targets one command may carry
+ *
+ * @param command e.g. "PRIVMSG", "JOIN", "KICK"
+ * @return size_t 0 for unlimited
+ */
+size_t isupport::maxTargets(std::string_view command) const {
+    auto found = targmax.find(std::string(command));
+    if (found != targmax.end()) return found->second;
+    if (command == "PRIVMSG" || command == "NOTICE") return maxTargetsDefault;
+    return 0;
+}
+
+bool isupport::isChannel(std::string_view name) const {
+    return name.size() && chantypes.find(name[0]) != std::string::npos;
+}
+
+/**
+ * @brief
+ *
+ * @return std::string json {"casemapping", "chantypes", "prefix": {"modes", "symbols"}, "maxTargets", "targmax",
+ * "lineLen", "nickLen", "channelLen", "topicLen", "network", "tokens"}
+ */
+std::string isupport::asJson() const {
+    json11::Json::object limits, raw;
+    for (auto it = targmax.begin(); it != targmax.end(); it++) limits[it->first] = (double)it->second;
+    for (auto it = tokens.begin(); it != tokens.end(); it++) raw[it->first] = it->second;
+    json11::Json ret = json11::Json::object{
+        {"casemapping", mappingNames[mapping]},
+        {"chantypes", chantypes},
+        {"prefix", json11::Json::object{{"modes", prefixModes}, {"symbols", prefixSymbols}}},
+        {"maxTargets", (double)maxTargetsDefault},
+        {"targmax", limits},
+        {"lineLen", (double)lineLen},
+        {"nickLen", (double)nickLen},
+        {"channelLen", (double)channelLen},
+        {"topicLen", (double)topicLen},
+        {"network", network},
+        {"tokens", raw}};
+    return ret.dump();
+}
+
+/**
+ * @brief writes the tokens as received, the typed fields are derived from them again on restore
+ *
+ * @param s
+ */
+void isupport::save(snapshot &s) const {
+    s.putVarint(tokens.size());
+    for (auto it = tokens.begin(); it != tokens.end(); it++) {
+        s.putString(it->first);
+        s.putString(it->second);
+    }
+}
+
+bool isupport::restore(snapshot &s) {
+    reset();
+    size_t count = s.getVarint();
+    for (size_t i = 0; i < count && s.ok(); i++) {
+        std::string key = s.getString(), value = s.getString();
+        tokens[key] = value;
+        apply(key, value, false);
+    }
+    return s.ok();
+}
+
+// sets the typed field of a token, a negated token goes back to its default
+void isupport::apply(const std::string &key, const std::string &value, bool negated) {
+    if (key == "CASEMAPPING") {
+        if (negated || value == "rfc1459") {
+            mapping = RFC1459;
+        } else if (value == "strict-rfc1459") {
+            mapping = STRICT_RFC1459;
+        } else if (value == "ascii") {
+            mapping = ASCII;
+        }
+        // unknown mappings (rfc7613...) keep the closest superset already set
+    } else if (key == "CHANTYPES") {
+        chantypes = negated ? "#&" : value;
+    } else if (key == "PREFIX") {
+        // (modes)symbols, an empty value means no prefixes at all
+        size_t close = value.find(')');
+        if (negated) {
+            prefixModes = "ov";
+            prefixSymbols = "@+";
+        } else if (value.size() && value[0] == '(' && close != std::string::npos) {
+            prefixModes = value.substr(1, close - 1);
+            prefixSymbols = value.substr(close + 1);
+        } else {
+            prefixModes.clear();
+            prefixSymbols.clear();
+        }
+    } else if (key == "MAXTARGETS") {
+        maxTargetsDefault = negated ? 0 : number(value, 0);
+    } else if (key == "TARGMAX") {
+        // PRIVMSG:4,NOTICE:4,JOIN:,KICK:1, an empty limit is unlimited
+        targmax.clear();
+        size_t start = 0;
+        while (!negated && start < value.size()) {
+            size_t end = value.find(',', start);
+            if (end == std::string::npos) end = value.size();
+            std::string item = value.substr(start, end - start);
+            size_t colon = item.find(':');
+            if (colon != std::string::npos) {
+                std::string command = item.substr(0, colon);
+                for (auto it = command.begin(); it != command.end(); it++) *it = std::toupper((unsigned char)*it);
+                targmax[command] = number(item.substr(colon + 1), 0);
+            }
+            start = end + 1;
+        }
+    } else if (key == "LINELEN") {
+        lineLen = negated ? 512 : number(value, 512);
+    } else if (key == "NICKLEN") {
+        nickLen = negated ? 9 : number(value, 9);
+    } else if (key == "CHANNELLEN") {
+        channelLen = negated ? 200 : number(value, 200);
+    } else if (key == "TOPICLEN") {
+        topicLen = negated ? 0 : number(value, 0);
+    } else if (key == "NETWORK") {
+        network = negated ? "" : value;
+    }
+}
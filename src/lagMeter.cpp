@@ -0,0 +1,99 @@
+#include "../include/lagMeter.hpp"
+
+#include <cstdlib>
+
+#include "../json/json11.hpp"
+
+// cookies look like lag-<n> so replies to PINGs sent with ircController::ping are left alone
+static const char cookiePrefix[] = "lag-";
+// PINGs still unanswered past this many are counted as lost
+static const size_t maxPending = 8;
+
+lagMeter::lagMeter() {
+    counter = 0;
+    reset();
+}
+
+/**
+ * @brief builds the next PING line and remembers when it was sent
+ *
+ * @param nowMs
+ * @return std::string "PING :lag-<n>"
+ */
+std::string lagMeter::ping(uint64_t nowMs) {
+    if (pending.size() == maxPending) {
+        pending.pop_front();
+        lost++;
+    }
+    pending.push_back({++counter, nowMs});
+    return "PING :" + std::string(cookiePrefix) + std::to_string(counter);
+}
+
+/**
+ * @brief times a PONG, older PINGs still waiting are counted as lost
+ *
+ * @param cookie last parameter of the PONG
+ * @param nowMs
+ * @return true if the cookie is one of ours
+ */
+bool lagMeter::pong(std::string_view cookie, uint64_t nowMs) {
+    size_t prefix = sizeof(cookiePrefix) - 1;
+    if (cookie.substr(0, prefix) != cookiePrefix) return false;
+    uint32_t id = (uint32_t)std::strtoul(std::string(cookie.substr(prefix)).c_str(), nullptr, 10);
+    for (auto it = pending.begin(); it != pending.end(); it++) {
+        if (it->id != id) continue;
+        last = nowMs > it->sent ? (double)(nowMs - it->sent) : 0;
+        // smoothed like TCP's SRTT, the first sample is taken as is
+        average = samples ? average + (last - average) / 8 : last;
+        if (last > max) max = last;
+        samples++;
+        lost += it - pending.begin();
+        pending.erase(pending.begin(), it + 1);
+        return true;
+    }
+    // ours but already given up on
+    return true;
+}
+
+/**
+ * @brief new connection, samples from the previous one are dropped
+ */
+void lagMeter::reset() {
+    pending.clear();
+    last = average = max = 0;
+    samples = lost = 0;
+}
+
+/**
+ * @brief last round trip, or how long the oldest PING has been waiting if that is longer
+ *
+ * @param nowMs
+ * @return double ms
+ */
+double lagMeter::current(uint64_t nowMs) {
+    if (pending.empty() || nowMs <= pending.front().sent) return last;
+    double waiting = (double)(nowMs - pending.front().sent);
+    return waiting > last ? waiting : last;
+}
+
+/**
+ * @brief
+ *
+ * @param nowMs
+ * @param outbound lines waiting to be sent
+ * @param ingest received lines waiting to be handled
+ * @return std::string json {"currentMs", "averageMs", "maxMs", "samples", "lost", "outstanding", "outboundQueued",
+ * "ingestPending"}
+ */
+std::string lagMeter::statsJson(uint64_t nowMs, size_t outbound, size_t ingest) {
+    json11::Json ret = json11::Json::object{
+        {"currentMs", current(nowMs)},
+        {"averageMs", average},
+        {"maxMs", max},
+        {"samples", (double)samples},
+        {"lost", (double)lost},
+        {"outstanding", (double)pending.size()},
+        {"outboundQueued", (double)outbound},
+        {"ingestPending", (double)ingest}};
+    return ret.dump();
+}
@@ -4,31 +4,31 @@ extern ircController *ircC;
 static EMSCRIPTEN_WEBSOCKET_T ws;
 
 EM_BOOL onopen(int eventType, const EmscriptenWebSocketOpenEvent *websocketEvent, void *userData) {
-    if (!ircController::websocket) {
-        ircController::websocket = websocketEvent->socket;
-    }
+    ircController::websocket = websocketEvent->socket;
+    if (ircC != nullptr) ircC->socketOpened();
     return EM_TRUE;
 }
 
 EM_BOOL onerror(int eventType, const EmscriptenWebSocketErrorEvent *websocketEvent, void *userData) {
     ircController::websocket = 0;
+    if (ircC != nullptr) ircC->socketClosed();
     return EM_TRUE;
 }
 
 EM_BOOL onclose(int eventType, const EmscriptenWebSocketCloseEvent *websocketEvent, void *userData) {
     ircController::websocket = 0;
-
+    if (ircC != nullptr) ircC->socketClosed();
     return EM_TRUE;
 }
 
 EM_BOOL onmessage(int eventType, const EmscriptenWebSocketMessageEvent *websocketEvent, void *userData) {
     if (ircC == nullptr) return EM_TRUE;
-    if (websocketEvent->isText) {
-        // For only ascii chars.
-        ircC->categorizeMsg((char *)websocketEvent->data);
-    } else {
-        std::cout << "Unkown event" << std::endl;
-    }
+    // text and binary frames are both read as (pointer, length)
+    // text frames carry a NUL terminator that is counted in numBytes, binary frames do not
+    // UTF-8 validated, legacy charsets transcoded in categorizeMsg
+    size_t len = websocketEvent->numBytes;
+    if (websocketEvent->isText && len) len--;
+    ircC->ingest((const char *)websocketEvent->data, len);
     return EM_TRUE;
 }
 
@@ -36,6 +36,14 @@ void openWebSocket(std::string url, std::string port) {
     std::string str_resolver = (url + ":" + port);
     EmscriptenWebSocketCreateAttributes ws_attrs = {str_resolver.c_str(), NULL, EM_TRUE};
     ws = emscripten_websocket_new(&ws_attrs);
+    if (ircC != nullptr) {
+        // a lost connection is reopened to the same server
+        ircC->reopen = [url, port]() {
+            emscripten_websocket_delete(ws);
+            openWebSocket(url, port);
+        };
+        ircC->socketConnecting();
+    }
 
     emscripten_websocket_set_onopen_callback(ws, NULL, onopen);
     emscripten_websocket_set_onerror_callback(ws, NULL, onerror);
@@ -48,7 +56,9 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 }
-//
+
+// the C ABI build (-DIRC_CAPI) exports the functions in capi.cpp instead
+#ifndef IRC_CAPI
 EMSCRIPTEN_BINDINGS(websocket) {
     emscripten::function("openWebSocket", &openWebSocket);
 }
@@ -58,8 +68,51 @@ EMSCRIPTEN_BINDINGS(irc_controller) {
     emscripten::class_<ircController>("ircController")
         .constructor()
         .function("getChannels", &ircController::getChannels)
+        .function("getMembers", &ircController::getMembers)
+        .function("completeNick", &ircController::completeNick)
+        .function("getPresence", &ircController::getPresence)
+        .function("registerUser", &ircController::registerUser)
         .function("getNextMessage", &ircController::getNextMessage)
+        .function("subscribe", &ircController::subscribe)
+        .function("unsubscribe", &ircController::unsubscribe)
+        .function("getTargetMessages", &ircController::getTargetMessages)
+        .function("renderTargetMessages", &ircController::renderTargetMessages)
+        .function("renderOwnMessage", &ircController::renderOwnMessage)
+        .function("getUnreadCounts", &ircController::getUnreadCounts)
+        .function("getNextInfoMessage", &ircController::getNextInfoMessage)
+        .function("getNextReply", &ircController::getNextReply)
+        .function("getListPage", &ircController::getListPage)
         .function("getWebsocketConnection", &ircController::getWebsocketConnection)
+        .function("setDebug", &ircController::setDebug)
+        .function("setCharset", &ircController::setCharset)
+        .function("setProfiling", &ircController::setProfiling)
+        .function("startCapture", &ircController::startCapture)
+        .function("stopCapture", &ircController::stopCapture)
+        .function("getMemoryUsage", &ircController::getMemoryUsage)
+        .function("setMemoryBudget", &ircController::setMemoryBudget)
+        .function("setIngestBudget", &ircController::setIngestBudget)
+        .function("getSchedulerStats", &ircController::getSchedulerStats)
+        .function("setPacing", &ircController::setPacing)
+        .function("setLagInterval", &ircController::setLagInterval)
+        .function("getLagStats", &ircController::getLagStats)
+        .function("saveSnapshot", &ircController::saveSnapshot)
+        .function("restoreSnapshot", &ircController::restoreSnapshot)
+        .function("setAutosave", &ircController::setAutosave)
+        .function("setReconnect", &ircController::setReconnect)
+        .function("setPresenceRefresh", &ircController::setPresenceRefresh)
+        .function("openLog", &ircController::openLog)
+        .function("closeLog", &ircController::closeLog)
+        .function("getHistory", &ircController::getHistory)
+        .function("seekHistory", &ircController::seekHistory)
+        .function("setCapabilities", &ircController::setCapabilities)
+        .function("getConnectionState", &ircController::getConnectionState)
+        .function("getServerSettings", &ircController::getServerSettings)
+        .function("getNick", &ircController::getNick)
+        .function("setEventBuffer", &ircController::setEventBuffer)
+        .function("getEventViews", &ircController::getEventViews)
+        .function("getEventLayout", &ircController::getEventLayout)
+        .function("getEventCommands", &ircController::getEventCommands)
+        .function("getEventName", &ircController::getEventName)
         .function("away", &ircController::away)
         .function("admin", &ircController::admin)
         .function("die", &ircController::die)
@@ -81,6 +134,8 @@ EMSCRIPTEN_BINDINGS(irc_controller) {
         .function("lusers", &ircController::lusers)
         .function("mode", &ircController::mode)
         .function("modules", &ircController::modules)
+        .function("monitor", &ircController::monitor)
+        .function("unmonitor", &ircController::unmonitor)
         .function("motd", &ircController::motd)
         .function("names", &ircController::names)
         .function("nick", &ircController::nick)
@@ -105,5 +160,10 @@ EMSCRIPTEN_BINDINGS(irc_controller) {
         .function("who", &ircController::who)
         .function("whois", &ircController::whois)
         .function("whowas", &ircController::whowas)
-        .function("zline", &ircController::zline);
+        .function("zline", &ircController::zline)
+        .function("bulk", &ircController::bulk)
+        .function("bulkView", &ircController::bulkView)
+        .function("receive", &ircController::receive)
+        .function("getArgBuffer", &ircController::getArgBuffer);
 };
+#endif
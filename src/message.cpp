@@ -1,31 +1,37 @@
 #include "../include/message.hpp"
 
-message::message(std::string str, bool debug) {
-    unparsed_msg = str;
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+
+#include "../include/memoryUsage.hpp"
+
+message::message(std::string_view line, bool debug) {
     this->debug = debug;
-    parse();
+    parse(line);
 }
 
 void message::print_all() {
     if (!debug) return;
-    std::cout << "\\\\\\\\\\\\\\\\\\\\\\" << std::endl;
-    std::cout << "\\ unparsed_message: " << unparsed_msg << std::endl;
-    std::cout << "\\ prefix:           " << prefix << std::endl;
-    std::cout << "\\ server:           " << server << std::endl;
-    std::cout << "\\ nick:             " << nick << std::endl;
-    std::cout << "\\ user:             " << user << std::endl;
-    std::cout << "\\ host:             " << host << std::endl;
-    std::cout << "\\ command:          " << command << std::endl;
+    std::printf("\\\\\\\\\\\\\\\\\\\\\\\n");
+    std::printf("\\ unparsed_message: %s\n", msg.c_str());
+    std::printf("\\ prefix:           %s\n", prefix.c_str());
+    std::printf("\\ server:           %s\n", server.c_str());
+    std::printf("\\ nick:             %s\n", nick.c_str());
+    std::printf("\\ user:             %s\n", user.c_str());
+    std::printf("\\ host:             %s\n", host.c_str());
+    std::printf("\\ command:          %s\n", command.c_str());
     unsigned int auxCounter = 0;
     for (auto it = middle.begin(); it != middle.end(); it++) {
-        std::cout << "\\ middle[" << auxCounter++ << "]: " << (*it) << std::endl;
+        std::printf("\\ middle[%u]: %s\n", auxCounter++, it->c_str());
     }
-    std::cout << "\\ trailing:         " << trailing << std::endl;
-    std::cout << "\\\\\\\\\\\\\\\\\\\\\\" << std::endl;
+    std::printf("\\ trailing:         %s\n", trailing.c_str());
+    std::printf("\\\\\\\\\\\\\\\\\\\\\\\n");
 }
 
 // [ OPTIONAL ]
-//  <message>  ::= [':' <prefix> <SPACE> ] <command> <params> <crlf>
+//  <message>  ::= ['@' <tags> <SPACE> ] [':' <prefix> <SPACE> ] <command> <params> <crlf>
+//  <tags>     ::= <key> ['=' <value>] { ';' <key> ['=' <value>] }
 //  <prefix>   ::= <servername> | <nick> [ '!' <user> ] [ '@' <host> ]
 //  <command>  ::= <letter> { <letter> } | <number> <number> <number>
 //  <SPACE>    ::= ' ' { ' ' }
@@ -39,62 +45,134 @@ void message::print_all() {
 //  <crlf>     ::= CR LF
 //
 
-void message::parse() {
-    msg = unparsed_msg;
+/**
+ * @brief parses a single line without CR/LF.
+ * The line is a (pointer, length) view and does not need to be NUL terminated,
+ * it is copied once into msg and every field is cut from the view.
+ * Fields of a previous parse are cleared, a message may be reused for many lines and keeps its buffers
+ *
+ * @param line
+ */
+void message::parse(std::string_view line) {
+    msg.assign(line.data(), line.size());
+    prefix.clear();
+    server.clear();
+    nick.clear();
+    user.clear();
+    host.clear();
+    trailing.clear();
+    time.clear();
+    batch.clear();
+    middle.clear();
+    std::string_view rest = line;
+    // optional ['@' <tags> <SPACE> ], only time and batch are kept
+    if (rest.size() && rest[0] == '@') {
+        size_t end = rest.find(SPACE);
+        std::string_view tags = rest.substr(1, end == std::string_view::npos ? end : end - 1);
+        while (tags.size()) {
+            size_t semi = tags.find(';');
+            std::string_view tag = tags.substr(0, semi);
+            tags = semi == std::string_view::npos ? std::string_view() : tags.substr(semi + 1);
+            size_t eq = tag.find('=');
+            std::string_view key = tag.substr(0, eq), value = eq == std::string_view::npos ? std::string_view() : tag.substr(eq + 1);
+            if (key == "time") time.assign(value.data(), value.size());
+            if (key == "batch") batch.assign(value.data(), value.size());
+        }
+        rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+        while (rest.size() && rest[0] == SPACE) rest.remove_prefix(1);
+    }
     // optional [':' <prefix> <SPACE> ]
-    if (msg[0] == ':') {
-        prefix = msg.substr(1, msg.find_first_of(SPACE) - 1);
+    if (rest.size() && rest[0] == ':') {
+        size_t end = rest.find(SPACE);
+        std::string_view pfx = rest.substr(1, end == std::string_view::npos ? end : end - 1);
+        prefix.assign(pfx.data(), pfx.size());
         server = prefix;
-        if (prefix.find('!') != std::string::npos) {
-            nick = prefix.substr(0, prefix.find_first_of('!'));
-        }
-        if (prefix.find('!') != std::string::npos) {
-            size_t nickSize = prefix.substr(0, prefix.find_first_of('!')).size() + 1;
-            size_t domainSize = prefix.substr(prefix.find_first_of('@') + 1).size() + 1;
-            user = prefix.substr(prefix.find_first_of('!') + 1, prefix.size() - nickSize - domainSize);
+        size_t bang = pfx.find('!'), at = pfx.find('@');
+        if (bang != std::string_view::npos) {
+            nick.assign(pfx.data(), bang);
+            size_t userEnd = (at != std::string_view::npos && at > bang) ? at : pfx.size();
+            user.assign(pfx.data() + bang + 1, userEnd - bang - 1);
         }
-        if (prefix.find('@') != std::string::npos) {
-            host = prefix.substr(prefix.find_first_of('@') + 1);
+        if (at != std::string_view::npos) {
+            host.assign(pfx.data() + at + 1, pfx.size() - at - 1);
         }
         // get remaining // consume
-        msg = msg.substr(msg.find_first_of(SPACE) + 1);
+        rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
         // consume spaces
-        while (msg[0] == SPACE) msg = msg.substr(1);
+        while (rest.size() && rest[0] == SPACE) rest.remove_prefix(1);
     }
     // <command> <params> <crlf>
     // obligatory <command>
-    if (std::isalpha(msg[0])) {
-        //<letter> { <letter> }
-        while (msg[0] != SPACE) {
-            command += msg[0];
-            msg = msg.substr(1);
-        }
-    } else {
-        //<number> <number> <number>
-        command = msg.substr(0, 3);
-        msg = msg.substr(3);
-    }
+    //<letter> { <letter> } | <number> <number> <number>
+    size_t cmdEnd = rest.find(SPACE);
+    if (cmdEnd == std::string_view::npos) cmdEnd = rest.size();
+    command.assign(rest.data(), cmdEnd);
+    rest.remove_prefix(cmdEnd);
     // obligatory <params>
     // <SPACE> [ ':' <trailing> | <middle> <params> ]
-    // consume spaces
-    // start params
-    int aux = 0;
-    while (msg.size() > 0) {
-        while (msg[0] == SPACE) msg = msg.substr(1);
+    while (rest.size()) {
+        // consume spaces
+        while (rest.size() && rest[0] == SPACE) rest.remove_prefix(1);
+        if (!rest.size()) break;
         //':' <trailing>
-        if (msg[0] == ':') {
-            trailing = msg.substr(1);
+        if (rest[0] == ':') {
+            trailing.assign(rest.data() + 1, rest.size() - 1);
             break;
         }
         //<middle> <params>
-        else {
-            middle.push_back(msg.substr(0, msg.find_first_of(SPACE)));
-            msg = msg.substr(msg.find_first_of(SPACE));
-        }
+        size_t midEnd = rest.find(SPACE);
+        if (midEnd == std::string_view::npos) midEnd = rest.size();
+        middle.emplace_back(rest.data(), midEnd);
+        rest.remove_prefix(midEnd);
     }
     if (debug) print_all();
 }
 
+/**
+ * @brief bytes held by this message, object and heap
+ *
+ * @return size_t
+ */
+size_t message::memorySize() const {
+    return sizeof(message) + heapBytes(msg) + heapBytes(prefix) + heapBytes(server) + heapBytes(nick) +
+           heapBytes(user) + heapBytes(host) + heapBytes(command) + heapBytes(trailing) + heapBytes(crlf) +
+           heapBytes(time) + heapBytes(batch) + heapBytes(middle);
+}
+
+/**
+ * @brief the time tag as unix ms, see isoTime
+ *
+ * @return uint64_t 0 if there is none or it does not parse
+ */
+uint64_t message::serverTime() const {
+    return isoTime(time);
+}
+
+/**
+ * @brief a server-time value as unix ms, 2024-01-31T12:34:56.789Z. Fractions are milliseconds at most, .5 is
+ * 500 ms and digits past the third are dropped
+ *
+ * @param value
+ * @return uint64_t 0 if it does not parse
+ */
+uint64_t message::isoTime(std::string_view value) {
+    struct tm t = {};
+    int end = 0;
+    std::string text(value);
+    if (std::sscanf(text.c_str(), "%d-%d-%dT%d:%d:%d%n", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec, &end) < 6) return 0;
+    uint64_t ms = 0;
+    if (text[end] == '.') {
+        int scale = 100;
+        for (end++; std::isdigit((unsigned char)text[end]); end++) {
+            ms += (text[end] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    return (uint64_t)timegm(&t) * 1000 + ms;
+}
+
 std::string message::asJson() {
     json11::Json::array mids;
 
@@ -109,6 +187,7 @@ std::string message::asJson() {
         {"host", host},
         {"command", command},
         {"middle", mids},
-        {"trailing", trailing}};
+        {"trailing", trailing},
+        {"time", time}};
     return retJson.dump();
 }
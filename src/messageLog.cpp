@@ -0,0 +1,375 @@
+#include "../include/messageLog.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "../include/varint.hpp"
+
+// segments are sealed once they would grow past this
+static const uint64_t segmentBytes = 4 << 20;
+// one sparse index point every this many records of a target
+static const uint32_t indexEvery = 32;
+// segments mapped at a time
+static const size_t mappedMax = 4;
+
+static uint64_t unixMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void appendPoint(std::string &out, unsigned char kind, uint64_t time, uint32_t offset, std::string_view target) {
+    out += (char)kind;
+    appendVarint(out, time);
+    appendVarint(out, offset);
+    appendVarint(out, target.size());
+    out.append(target.data(), target.size());
+}
+
+messageLog::messageLog() {
+    segment = 0;
+    data = index = nullptr;
+    size = 0;
+    fold = isupport::foldTable(isupport::RFC1459);
+}
+
+messageLog::~messageLog() {
+    close();
+}
+
+/**
+ * @brief opens or creates a log directory and loads its sparse index.
+ * Only the active segment is scanned, to find the newest record of its targets and drop a torn last record
+ *
+ * @param dir in the browser a MEMFS or IDBFS path
+ * @return true
+ * @return false if the directory or the active segment cannot be opened
+ */
+bool messageLog::open(std::string dir) {
+    close();
+    ::mkdir(dir.c_str(), 0755);
+    DIR *listing = ::opendir(dir.c_str());
+    if (!listing) return false;
+    std::vector<uint32_t> numbers;
+    while (struct dirent *entry = ::readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name.size() != 12 || name.compare(8, 4, ".log") || name.find_first_not_of("0123456789") != 8) continue;
+        numbers.push_back((uint32_t)std::strtoul(name.c_str(), nullptr, 10));
+    }
+    ::closedir(listing);
+    std::sort(numbers.begin(), numbers.end());
+
+    this->dir = dir;
+    for (auto it = numbers.begin(); it != numbers.end(); it++) loadIndex(*it);
+    uint32_t active = numbers.size() ? numbers.back() : 1;
+    if (numbers.size() && !scan(active)) {
+        // appends may not follow a torn record that could not be cut off, that segment is sealed and a new one started
+        if (openSegment(active)) seal();
+        active++;
+    }
+    if (!openSegment(active)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief writes what is buffered and closes the log, the active segment stays open for appends on the next open
+ */
+void messageLog::close() {
+    flush();
+    if (data) std::fclose(data);
+    if (index) std::fclose(index);
+    data = index = nullptr;
+    while (mapped.size()) unmap(mapped.begin()->first);
+    targets.clear();
+    segment = 0;
+    size = 0;
+}
+
+bool messageLog::isOpen() {
+    return segment;
+}
+
+/**
+ * @brief targets are keyed by their casefolded name, set before opening
+ *
+ * @param table
+ */
+void messageLog::setCasemapping(const unsigned char *table) {
+    fold = table ? table : isupport::foldTable(isupport::RFC1459);
+}
+
+/**
+ * @brief buffers one line of a target, it reaches the file on the next flush
+ *
+ * @param target channel or nick
+ * @param line as received
+ * @param time unix ms, 0 for now
+ */
+void messageLog::append(std::string_view target, std::string_view line, uint64_t time) {
+    if (!segment || target.empty()) return;
+    std::string name = key(target);
+    history &h = targets[name];
+    if (!time) time = unixMs();
+
+    uint64_t prevSegment = h.last >> 32, prevOffset = h.last & 0xFFFFFFFF;
+    uint64_t length = varintSize(time) + varintSize(prevSegment) + varintSize(prevOffset) + varintSize(name.size()) + name.size() + line.size();
+    if (size && size + varintSize(length) + length > segmentBytes) {
+        flush();
+        seal();
+        if (!openSegment(segment + 1)) return;
+    }
+    uint64_t position = (uint64_t)segment << 32 | size;
+    size_t start = batch.size();
+    appendVarint(batch, length);
+    appendVarint(batch, time);
+    appendVarint(batch, prevSegment);
+    appendVarint(batch, prevOffset);
+    appendVarint(batch, name.size());
+    batch += name;
+    batch.append(line.data(), line.size());
+    size += batch.size() - start;
+    if (h.count++ % indexEvery == 0) {
+        h.points.push_back({time, position});
+        appendPoint(indexBatch, 0, time, (uint32_t)(position & 0xFFFFFFFF), name);
+    }
+    h.last = position;
+}
+
+/**
+ * @brief writes buffered records and index points, called once per ingest tick
+ */
+void messageLog::flush() {
+    if (data && batch.size()) {
+        std::fwrite(batch.data(), 1, batch.size(), data);
+        std::fflush(data);
+    }
+    if (index && indexBatch.size()) {
+        std::fwrite(indexBatch.data(), 1, indexBatch.size(), index);
+        std::fflush(index);
+    }
+    batch.clear();
+    indexBatch.clear();
+}
+
+/**
+ * @brief a page of history of one target, read by following the links from the newest record or from a cursor
+ *
+ * @param target
+ * @param cursor 0 for the newest records, otherwise the cursor of the previous page or from seek
+ * @param count
+ * @return std::string json {"cursor", "messages": [{"time", "message"}]} oldest first,
+ * cursor reads the page before this one and is 0 once the start of the history is reached
+ */
+std::string messageLog::page(std::string_view target, uint64_t cursor, size_t count) {
+    flush();
+    auto found = targets.find(key(target));
+    uint64_t position = found == targets.end() ? 0 : found->second.last;
+    record r;
+    if (cursor) position = read(cursor, r) ? r.prev : 0;
+
+    std::vector<std::string> items;
+    uint64_t oldest = 0;
+    while (position && items.size() < count && read(position, r)) {
+        message m(r.line);
+        items.push_back("{\"time\": " + std::to_string(r.time) + ", \"message\": " + m.asJson() + "}");
+        oldest = position;
+        position = r.prev;
+    }
+    std::string ret = "{\"cursor\": " + std::to_string(position ? oldest : 0) + ", \"messages\": [";
+    for (auto it = items.rbegin(); it != items.rend(); it++) {
+        if (it != items.rbegin()) ret += ",";
+        ret += *it;
+    }
+    return ret + "]}";
+}
+
+/**
+ * @brief finds where history before a point in time starts, the sparse index narrows it to a few records
+ *
+ * @param target
+ * @param time unix ms
+ * @return uint64_t cursor whose page ends right before time, 0 if every record is older
+ */
+uint64_t messageLog::seek(std::string_view target, uint64_t time) {
+    flush();
+    auto found = targets.find(key(target));
+    if (found == targets.end()) return 0;
+    history &h = found->second;
+    // first indexed record at or after time, the one before it is older so at most indexEvery links are followed
+    auto after = std::lower_bound(h.points.begin(), h.points.end(), time, [](const point &p, uint64_t t) { return p.time < t; });
+    uint64_t position = after == h.points.end() ? h.last : after->position;
+    record r;
+    if (!read(position, r) || r.time < time) return 0;
+    while (r.prev) {
+        record older;
+        if (!read(r.prev, older) || older.time < time) break;
+        position = r.prev;
+        r = older;
+    }
+    return position;
+}
+
+memoryUsage messageLog::usage() {
+    memoryUsage ret;
+    ret.count = targets.size();
+    ret.bytes = heapBytes(batch) + heapBytes(indexBatch) + targets.bucket_count() * sizeof(void *);
+    for (auto it = targets.begin(); it != targets.end(); it++) {
+        ret.bytes += sizeof(*it) + heapBytes(it->first) + heapBytes(it->second.points);
+    }
+    return ret;
+}
+
+/**
+ * @brief conversation a line is logged under: channel messages, notices, joins, parts, kicks, topics and modes,
+ * queries under the other side's nick
+ *
+ * @param m
+ * @param settings channel types and casemapping
+ * @param ownNick
+ * @return std::string_view empty if the line is not logged
+ */
+std::string_view messageLog::targetOf(const message &m, const isupport &settings, std::string_view ownNick) {
+    const std::string &first = m.middle.size() ? m.middle[0] : m.trailing;
+    if (m.command == "PRIVMSG" || m.command == "NOTICE") {
+        if (settings.isChannel(first)) return first;
+        // server notices are not a conversation, a query is filed under the other side
+        if (m.nick.empty()) return "";
+        const unsigned char *fold = settings.foldTable();
+        bool own = m.nick.size() == ownNick.size();
+        for (size_t i = 0; own && i < ownNick.size(); i++) own = fold[(unsigned char)m.nick[i]] == fold[(unsigned char)ownNick[i]];
+        return own ? std::string_view(first) : std::string_view(m.nick);
+    }
+    bool channelCommand = m.command == "JOIN" || m.command == "PART" || m.command == "KICK" || m.command == "TOPIC" || m.command == "MODE";
+    return channelCommand && settings.isChannel(first) ? std::string_view(first) : std::string_view();
+}
+
+std::string messageLog::key(std::string_view target) {
+    std::string ret(target);
+    for (auto it = ret.begin(); it != ret.end(); it++) *it = (char)fold[(unsigned char)*it];
+    return ret;
+}
+
+std::string messageLog::path(uint32_t number, const char *extension) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "%08u.%s", number, extension);
+    return dir + "/" + name;
+}
+
+bool messageLog::openSegment(uint32_t number) {
+    if (data) std::fclose(data);
+    if (index) std::fclose(index);
+    data = std::fopen(path(number, "log").c_str(), "ab");
+    index = std::fopen(path(number, "idx").c_str(), "ab");
+    if (!data || !index) return false;
+    std::fseek(data, 0, SEEK_END);
+    size = std::ftell(data);
+    segment = number;
+    return true;
+}
+
+// closes the active segment for good, its index learns the newest record of every target in it
+void messageLog::seal() {
+    for (auto it = targets.begin(); it != targets.end(); it++) {
+        if (it->second.last >> 32 == segment) appendPoint(indexBatch, 1, 0, (uint32_t)(it->second.last & 0xFFFFFFFF), it->first);
+    }
+    flush();
+}
+
+void messageLog::loadIndex(uint32_t number) {
+    FILE *file = std::fopen(path(number, "idx").c_str(), "rb");
+    if (!file) return;
+    std::string in;
+    char buf[65536];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), file)) > 0) in.append(buf, n);
+    std::fclose(file);
+
+    size_t at = 0;
+    uint64_t time, offset, length;
+    while (at < in.size()) {
+        unsigned char kind = in[at++];
+        if (!readVarint(in, at, time) || !readVarint(in, at, offset) || !readVarint(in, at, length) || in.size() - at < length) break;
+        history &h = targets[in.substr(at, length)];
+        at += length;
+        uint64_t position = (uint64_t)number << 32 | offset;
+        if (kind == 0) h.points.push_back({time, position});
+        if (kind == 1) h.last = position;
+    }
+}
+
+// finds the newest record of every target in a segment, a torn record at the end is cut off, false if that failed
+bool messageLog::scan(uint32_t number) {
+    std::string_view in = bytes(number);
+    size_t at = 0;
+    record r;
+    while (at < in.size()) {
+        uint64_t position = (uint64_t)number << 32 | at;
+        size_t start = at;
+        uint64_t length;
+        if (!readVarint(in, at, length) || in.size() - at < length || !read(position, r)) {
+            at = start;
+            break;
+        }
+        targets[std::string(r.target)].last = position;
+        at += length;
+    }
+    if (at < in.size()) {
+        unmap(number);
+        if (::truncate(path(number, "log").c_str(), at) != 0) return false;
+    }
+    return true;
+}
+
+// whole segment mapped read only, the active one is mapped again once it grew
+std::string_view messageLog::bytes(uint32_t number) {
+    size_t length = number == segment ? size - batch.size() : 0;
+    auto found = mapped.find(number);
+    if (found != mapped.end() && (number != segment || found->second.length == length)) {
+        return std::string_view((const char *)found->second.addr, found->second.length);
+    }
+    unmap(number);
+    int fd = ::open(path(number, "log").c_str(), O_RDONLY);
+    if (fd < 0) return std::string_view();
+    if (number != segment) {
+        struct stat st;
+        length = ::fstat(fd, &st) == 0 ? st.st_size : 0;
+    }
+    void *addr = length ? ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (addr == MAP_FAILED) return std::string_view();
+    if (mapped.size() >= mappedMax) unmap(mapped.begin()->first == segment ? mapped.rbegin()->first : mapped.begin()->first);
+    mapped[number] = {addr, length};
+    return std::string_view((const char *)addr, length);
+}
+
+void messageLog::unmap(uint32_t number) {
+    auto found = mapped.find(number);
+    if (found == mapped.end()) return;
+    ::munmap(found->second.addr, found->second.length);
+    mapped.erase(found);
+}
+
+bool messageLog::read(uint64_t position, record &out) {
+    std::string_view in = bytes(position >> 32);
+    size_t at = position & 0xFFFFFFFF;
+    uint64_t length, prevSegment, prevOffset, targetLength;
+    if (at >= in.size() || !readVarint(in, at, length) || in.size() - at < length) return false;
+    std::string_view body = in.substr(at, length);
+    at = 0;
+    if (!readVarint(body, at, out.time) || !readVarint(body, at, prevSegment) || !readVarint(body, at, prevOffset) ||
+        !readVarint(body, at, targetLength) || body.size() - at < targetLength) {
+        return false;
+    }
+    out.prev = prevSegment ? prevSegment << 32 | prevOffset : 0;
+    out.target = body.substr(at, targetLength);
+    out.line = body.substr(at + targetLength);
+    return true;
+}
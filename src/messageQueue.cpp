@@ -0,0 +1,77 @@
+#include "../include/messageQueue.hpp"
+
+/**
+ * @brief appends message, evicting from the front while over budget
+ *
+ * @param m
+ */
+void messageQueue::push(message &&m) {
+    stats.bytes += m.memorySize();
+    items.push_back(std::move(m));
+    while (stats.budget && stats.bytes > stats.budget && items.size() > 1) {
+        pop();
+        stats.evicted++;
+    }
+}
+
+message &messageQueue::front() {
+    return items.front();
+}
+
+void messageQueue::pop() {
+    stats.bytes -= items.front().memorySize();
+    items.pop_front();
+}
+
+bool messageQueue::empty() {
+    return items.empty();
+}
+
+size_t messageQueue::size() {
+    return items.size();
+}
+
+/**
+ * @brief sets budget and evicts right away if it is already exceeded
+ *
+ * @param bytes 0 for unbounded
+ */
+void messageQueue::setBudget(size_t bytes) {
+    stats.budget = bytes;
+    while (stats.budget && stats.bytes > stats.budget && items.size()) {
+        pop();
+        stats.evicted++;
+    }
+}
+
+/**
+ * @brief writes the newest messages as their raw lines
+ *
+ * @param s
+ * @param tail at most this many
+ */
+void messageQueue::save(snapshot &s, size_t tail) {
+    size_t start = items.size() > tail ? items.size() - tail : 0;
+    s.putVarint(items.size() - start);
+    for (size_t i = start; i < items.size(); i++) s.putString(items[i].msg);
+}
+
+/**
+ * @brief replaces the queue with saved messages, parsed again
+ *
+ * @param s
+ * @return true
+ * @return false if the image is damaged
+ */
+bool messageQueue::restore(snapshot &s) {
+    items.clear();
+    stats.bytes = 0;
+    size_t count = s.getVarint();
+    for (size_t i = 0; i < count && s.ok(); i++) push(message(s.getString()));
+    return s.ok();
+}
+
+memoryUsage messageQueue::usage() {
+    stats.count = items.size();
+    return stats;
+}
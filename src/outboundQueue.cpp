@@ -0,0 +1,116 @@
+#include "../include/outboundQueue.hpp"
+
+#include <cmath>
+
+outboundQueue::outboundQueue() {
+    rate = 0;
+    tokens = 0;
+    burst = 0;
+    refilled = 0;
+}
+
+/**
+ * @brief paces bulk lines, rate lines per second on average with up to burst lines back to back
+ *
+ * @param linesPerSecond 0 sends everything right away
+ * @param burst
+ */
+void outboundQueue::setPacing(double linesPerSecond, size_t burst) {
+    rate = linesPerSecond > 0 ? linesPerSecond : 0;
+    this->burst = burst ? burst : 1;
+    tokens = (double)this->burst;
+    refilled = 0;
+}
+
+/**
+ * @brief queues a frame, several lines may be CRLF joined
+ *
+ * @param frame
+ * @param priority control lines that must not wait behind bulk traffic
+ */
+void outboundQueue::push(const std::string &frame, bool priority) {
+    split(frame, priority ? this->priority : bulk);
+}
+
+/**
+ * @brief takes what may be written now as one CRLF joined frame.
+ * Priority lines always go and still use up tokens, bulk lines go while tokens are left
+ *
+ * @param frame
+ * @param nowMs
+ * @return true if there is something to write
+ */
+bool outboundQueue::next(std::string &frame, uint64_t nowMs) {
+    frame.clear();
+    refill(nowMs);
+    while (priority.size()) {
+        if (frame.size()) frame += "\r\n";
+        frame += priority.front();
+        priority.pop_front();
+        if (rate) tokens = std::max(tokens - 1, -(double)burst);
+    }
+    while (bulk.size() && (!rate || tokens >= 1)) {
+        if (frame.size()) frame += "\r\n";
+        frame += bulk.front();
+        bulk.pop_front();
+        if (rate) tokens--;
+    }
+    return frame.size();
+}
+
+/**
+ * @brief
+ *
+ * @param nowMs
+ * @return uint64_t ms until the next bulk line may go, 0 if none is waiting
+ */
+uint64_t outboundQueue::wait(uint64_t nowMs) {
+    if (bulk.empty() || !rate) return 0;
+    refill(nowMs);
+    if (tokens >= 1) return 0;
+    return (uint64_t)std::ceil((1 - tokens) * 1000 / rate);
+}
+
+size_t outboundQueue::queued() {
+    return priority.size() + bulk.size();
+}
+
+void outboundQueue::clear() {
+    priority.clear();
+    bulk.clear();
+    tokens = (double)burst;
+}
+
+/**
+ * @brief moves the bulk lines out, for a reconnect to send them again. Priority lines are left, they are stale by then
+ *
+ * @param out lines are appended
+ */
+void outboundQueue::takeBulk(std::vector<std::string> &out) {
+    for (auto it = bulk.begin(); it != bulk.end(); it++) out.push_back(std::move(*it));
+    bulk.clear();
+}
+
+memoryUsage outboundQueue::usage() {
+    memoryUsage ret;
+    ret.count = queued();
+    for (auto it = priority.begin(); it != priority.end(); it++) ret.bytes += sizeof(std::string) + heapBytes(*it);
+    for (auto it = bulk.begin(); it != bulk.end(); it++) ret.bytes += sizeof(std::string) + heapBytes(*it);
+    return ret;
+}
+
+void outboundQueue::refill(uint64_t nowMs) {
+    if (!rate) return;
+    if (refilled && nowMs > refilled) tokens = std::min((double)burst, tokens + (nowMs - refilled) * rate / 1000);
+    refilled = nowMs;
+}
+
+void outboundQueue::split(const std::string &frame, std::deque<std::string> &lane) {
+    size_t start = 0;
+    while (start < frame.size()) {
+        size_t end = frame.find("\r\n", start);
+        if (end == std::string::npos) end = frame.size();
+        if (end > start) lane.push_back(frame.substr(start, end - start));
+        start = end + 2;
+    }
+}
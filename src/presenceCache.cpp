@@ -0,0 +1,507 @@
+#include "../include/presenceCache.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "../json/json11.hpp"
+
+// WHOX query type of our refresh lines, replies carrying it are ours: token user host nick flags account :realname
+static const char *whoxToken = "11";
+static const char *whoxFields = " %tuhnfar,11";
+// until setBudget says otherwise, a few thousand users
+static const size_t defaultBudget = 1 << 20;
+
+static json11::Json tristate(int value) {
+    if (value == 0) return json11::Json();
+    return value == 2;
+}
+
+presenceCache::presenceCache(internPool &pool) : pool(pool) {
+    monitoring = 0;
+    staleMs = 0;
+    stats.budget = defaultBudget;
+}
+
+/**
+ * @brief learns from a received message, after the roster took it
+ *
+ * @param m
+ * @param nowMs unix ms
+ * @param members tells who shares a channel with us
+ * @param ownNick
+ * @return true if the message answers one of our refresh lines and should go no further
+ */
+bool presenceCache::offer(message &m, uint64_t nowMs, roster &members, const std::string &ownNick) {
+    const std::string &command = m.command;
+    const std::string &first = m.middle.size() ? m.middle[0] : m.trailing;
+    bool numeric = command.size() == 3 && std::isdigit((unsigned char)command[0]);
+
+    if (!numeric) {
+        if (m.nick.empty() || m.host.empty()) return false;
+        bool kicked = command == "KICK" && m.middle.size() >= 2;
+        if (kicked) left(m.middle[1], members);
+        // our channel is gone, and with it what some users shared with us
+        if ((command == "PART" && pool.equal(m.nick, ownNick)) || (kicked && pool.equal(m.middle[1], ownNick))) sweep(members);
+        uint32_t id = pool.find(m.nick);
+        entry *e = id && members.shares(id) ? touch(m.nick) : find(m.nick);
+        if (!e) return false;
+        setHost(*e, m.host);
+        set(e->user, m.user);
+        e->seen = nowMs;
+        e->online = command == "QUIT" ? NO : YES;
+        if (command == "JOIN" && m.middle.size() >= 2) {
+            // extended-join, <channel> <account> :<realname>
+            set(e->account, m.middle[1]);
+            set(e->realname, m.trailing);
+        } else if (command == "AWAY") {
+            e->away = m.trailing.size() ? YES : NO;
+            set(e->awayMessage, m.trailing);
+        } else if (command == "ACCOUNT") {
+            set(e->account, first);
+        } else if (command == "CHGHOST" && m.middle.size()) {
+            set(e->user, m.middle[0]);
+            setHost(*e, m.middle.size() >= 2 ? m.middle[1] : m.trailing);
+        } else if (command == "SETNAME") {
+            set(e->realname, m.trailing);
+        } else if (command == "NICK") {
+            rename(m.nick, first);
+        } else if (command == "QUIT" && !e->watched) {
+            erase(entries.find(id));
+        } else if (command == "PART") {
+            left(m.nick, members);
+        }
+        return false;
+    }
+
+    if (command == "354" && m.middle.size() >= 7 && m.middle[1] == whoxToken) {
+        // <me> <token> <user> <host> <nick> <flags> <account> :<realname>
+        entry *e = admit(m.middle[4], members);
+        if (!e) return true;
+        set(e->user, m.middle[2]);
+        setHost(*e, m.middle[3]);
+        set(e->account, m.middle[6] == "0" ? "*" : m.middle[6]);
+        set(e->realname, m.trailing);
+        e->away = m.middle[5].size() && m.middle[5][0] == 'G' ? YES : NO;
+        if (e->away == NO) set(e->awayMessage, "");
+        e->online = YES;
+        e->refreshed = nowMs;
+        e->wanted = false;
+        return true;
+    }
+    if (command == "315" && m.middle.size() >= 2 && whoMasks.size() && pool.equal(whoMasks.front(), m.middle[1])) {
+        whoMasks.pop_front();
+        // a nick that got no reply is not on the network
+        entry *e = find(m.middle[1]);
+        if (e && e->asked > e->refreshed) {
+            e->online = NO;
+            e->refreshed = nowMs;
+            e->wanted = false;
+        }
+        return true;
+    }
+
+    if (command == "301" && m.middle.size() >= 2) {
+        entry *e = admit(m.middle[1], members);
+        if (e) {
+            e->away = YES;
+            set(e->awayMessage, m.trailing);
+        }
+    } else if (command == "311" && m.middle.size() >= 4) {
+        // <me> <nick> <user> <host> * :<realname>
+        entry *e = admit(m.middle[1], members);
+        if (e) {
+            set(e->user, m.middle[2]);
+            setHost(*e, m.middle[3]);
+            set(e->realname, m.trailing);
+            e->online = YES;
+        }
+    } else if (command == "330" && m.middle.size() >= 3) {
+        entry *e = admit(m.middle[1], members);
+        if (e) set(e->account, m.middle[2]);
+    } else if (command == "352" && m.middle.size() >= 7) {
+        // <me> <channel> <user> <host> <server> <nick> <flags> :<hops> <realname>
+        entry *e = admit(m.middle[5], members);
+        if (e) {
+            set(e->user, m.middle[2]);
+            setHost(*e, m.middle[3]);
+            size_t space = m.trailing.find(' ');
+            set(e->realname, space == std::string::npos ? "" : std::string_view(m.trailing).substr(space + 1));
+            e->away = m.middle[6].size() && m.middle[6][0] == 'G' ? YES : NO;
+            e->online = YES;
+        }
+    } else if (command == "730" || command == "731") {
+        // RPL_MONONLINE :nick!user@host,... RPL_MONOFFLINE :nick,...
+        std::string_view list = m.trailing;
+        while (list.size()) {
+            size_t comma = list.find(',');
+            std::string_view target = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            size_t bang = target.find('!'), at = target.find('@');
+            // watched nicks have their entry already
+            entry *e = find(target.substr(0, bang));
+            if (!e) continue;
+            e->online = command == "730" ? YES : NO;
+            if (bang != std::string_view::npos && at != std::string_view::npos && at > bang) {
+                set(e->user, target.substr(bang + 1, at - bang - 1));
+                setHost(*e, target.substr(at + 1));
+            }
+        }
+    } else if (command == "734" && m.middle.size() >= 3) {
+        // ERR_MONLISTFULL <me> <limit> <targets>, those did not make it on the list
+        std::string_view list = m.middle[2];
+        while (list.size()) {
+            size_t comma = list.find(',');
+            entry *e = find(list.substr(0, comma));
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            if (e && e->monitored) {
+                e->monitored = false;
+                monitoring--;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief what is known about a nick, marks it for the next refresh round if it is stale
+ *
+ * @param nick
+ * @param nowMs unix ms
+ * @param settings channel types, a channel name is not a nick
+ * @return std::string json {"nick", "user", "host", "account", "realname", "away", "awayMessage", "online",
+ * "lastSeen", "refreshed", "watched"}, away and online are null while unknown, empty if nothing is known yet
+ */
+std::string presenceCache::lookup(std::string_view nick, uint64_t nowMs, const isupport &settings) {
+    uint32_t id = pool.find(nick);
+    auto it = entries.find(id);
+    if (!id || it == entries.end()) {
+        // looked up, so worth asking for on the next round, unless it is a channel or a mask that would make
+        // the refresh a WHO on many users
+        bool nickname = nick.size() && settings.chantypes.find(nick[0]) == std::string::npos &&
+                        nick.find_first_of(std::string_view(" ,*?!@\r\n", 9)) == std::string_view::npos;
+        entry *e = staleMs && nickname ? touch(nick) : nullptr;
+        if (e) e->wanted = true;
+        return "";
+    }
+    entry &e = it->second;
+    if (due(e, nowMs)) e.wanted = true;
+    json11::Json ret = json11::Json::object{
+        {"nick", pool.name(id)},
+        {"user", e.user},
+        {"host", e.host ? pool.name(e.host) : ""},
+        {"account", e.account},
+        {"realname", e.realname},
+        {"away", tristate(e.away)},
+        {"awayMessage", e.awayMessage},
+        {"online", tristate(e.online)},
+        {"lastSeen", (double)e.seen},
+        {"refreshed", (double)e.refreshed},
+        {"watched", e.watched}};
+    return ret.dump();
+}
+
+/**
+ * @brief age after which an entry that is looked up or watched is asked for again
+ *
+ * @param ms 0 never refreshes
+ */
+void presenceCache::setStaleAfter(uint64_t ms) {
+    staleMs = ms;
+}
+
+/**
+ * @brief WHOX lines for the stale entries that were looked up, and watched ones MONITOR does not cover.
+ * A channel where they are at least a quarter of the members is asked for as a whole, the rest one nick a line
+ *
+ * @param nowMs unix ms
+ * @param members
+ * @param settings nothing is sent without WHOX
+ * @param maxLines
+ * @param out lines are appended
+ */
+void presenceCache::refresh(uint64_t nowMs, roster &members, const isupport &settings, size_t maxLines, std::vector<std::string> &out) {
+    if (!staleMs || !settings.tokens.count("WHOX")) return;
+    std::vector<uint32_t> pending, shared;
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        const entry &e = it->second;
+        if ((e.wanted || (e.watched && !e.monitored)) && due(e, nowMs)) pending.push_back(it->first);
+    }
+
+    size_t lines = 0;
+    std::unordered_map<uint32_t, size_t> counts;
+    while (pending.size() > 1 && lines < maxLines) {
+        counts.clear();
+        for (auto it = pending.begin(); it != pending.end(); it++) {
+            members.channelsOf(*it, shared);
+            for (auto c = shared.begin(); c != shared.end(); c++) counts[*c]++;
+        }
+        uint32_t best = 0;
+        size_t most = 0;
+        for (auto it = counts.begin(); it != counts.end(); it++) {
+            if (it->second > most) {
+                best = it->first;
+                most = it->second;
+            }
+        }
+        if (most < 2 || most * 4 < members.count(best)) break;
+        std::string channel = pool.name(best);
+        out.push_back("WHO " + channel + whoxFields);
+        whoMasks.push_back(channel);
+        lines++;
+        auto keep = pending.begin();
+        for (auto it = pending.begin(); it != pending.end(); it++) {
+            members.channelsOf(*it, shared);
+            if (std::find(shared.begin(), shared.end(), best) != shared.end()) {
+                entries[*it].asked = nowMs;
+            } else {
+                *keep++ = *it;
+            }
+        }
+        pending.erase(keep, pending.end());
+    }
+    for (auto it = pending.begin(); it != pending.end() && lines < maxLines; it++) {
+        std::string nick = pool.name(*it);
+        out.push_back("WHO " + nick + whoxFields);
+        whoMasks.push_back(nick);
+        entries[*it].asked = nowMs;
+        lines++;
+    }
+}
+
+/**
+ * @brief starts or stops watching nicks, MONITOR lines for the server if it offers MONITOR and has room left
+ *
+ * @param nicks
+ * @param add
+ * @param registered lines can go now, otherwise resync sends them once registered
+ * @param settings
+ * @param room bytes a line may take
+ * @param out lines are appended
+ */
+void presenceCache::watch(const argList &nicks, bool add, bool registered, const isupport &settings, size_t room,
+                          std::vector<std::string> &out) {
+    size_t limit = registered ? monitorLimit(settings) : 0;
+    argList changed;
+    for (auto it = nicks.begin(); it != nicks.end(); it++) {
+        if (it->empty()) continue;
+        entry *e = add ? touch(*it) : find(*it);
+        if (!e) continue;
+        e->watched = add;
+        if (add && !e->monitored && monitoring < limit) {
+            e->monitored = true;
+            monitoring++;
+            changed.push_back(*it);
+        } else if (!add && e->monitored) {
+            e->monitored = false;
+            monitoring--;
+            changed.push_back(*it);
+        }
+    }
+    pack(out, add ? "MONITOR +" : "MONITOR -", changed, room);
+}
+
+/**
+ * @brief MONITOR lines for the watched nicks not on the server's list yet, once registered
+ *
+ * @param settings
+ * @param room
+ * @param out lines are appended
+ */
+void presenceCache::resync(const isupport &settings, size_t room, std::vector<std::string> &out) {
+    size_t limit = monitorLimit(settings);
+    std::vector<std::string> names;
+    for (auto it = entries.begin(); it != entries.end() && monitoring < limit; it++) {
+        if (!it->second.watched || it->second.monitored) continue;
+        it->second.monitored = true;
+        monitoring++;
+        names.push_back(pool.name(it->first));
+    }
+    pack(out, "MONITOR +", views(names), room);
+}
+
+/**
+ * @brief connection lost, nothing is in flight and online states are unknown until the next one tells
+ */
+void presenceCache::closed() {
+    whoMasks.clear();
+    monitoring = 0;
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        it->second.monitored = false;
+        it->second.online = UNKNOWN;
+        it->second.asked = 0;
+    }
+}
+
+void presenceCache::clear() {
+    while (entries.size()) erase(entries.begin());
+    whoMasks.clear();
+    monitoring = 0;
+}
+
+/**
+ * @brief past the budget the least recently seen entries that are not watched are dropped
+ *
+ * @param bytes 0 for unbounded, 1 MiB until set
+ */
+void presenceCache::setBudget(size_t bytes) {
+    stats.budget = bytes;
+    evict();
+}
+
+/**
+ * @brief counts the intern pool references the entries hold, for a snapshot that does not keep them
+ *
+ * @param held added to, by id
+ */
+void presenceCache::refs(std::unordered_map<uint32_t, uint32_t> &held) const {
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        held[it->first]++;
+        if (it->second.host) held[it->second.host]++;
+    }
+}
+
+memoryUsage presenceCache::usage() {
+    stats.count = entries.size();
+    return stats;
+}
+
+presenceCache::entry *presenceCache::find(std::string_view nick) {
+    auto it = entries.find(pool.find(nick));
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+// the entry of a nick a reply is about: existing ones, and new ones only for users sharing a channel with us,
+// so a WHO or WHOIS on strangers does not fill the cache
+presenceCache::entry *presenceCache::admit(std::string_view nick, roster &members) {
+    entry *e = find(nick);
+    if (e) return e;
+    uint32_t id = pool.find(nick);
+    return id && members.shares(id) ? touch(nick) : nullptr;
+}
+
+// finds or creates the entry of a nick
+presenceCache::entry *presenceCache::touch(std::string_view nick) {
+    entry *e = find(nick);
+    if (e || nick.empty()) return e;
+    evict();
+    uint32_t id = pool.intern(nick);
+    if (!id) return nullptr;
+    stats.bytes += sizeof(entry) + sizeof(uint32_t) + 2 * sizeof(void *);
+    return &entries[id];
+}
+
+void presenceCache::set(std::string &field, std::string_view value) {
+    if (field == value) return;
+    stats.bytes -= heapBytes(field);
+    field.assign(value.data(), value.size());
+    stats.bytes += heapBytes(field);
+}
+
+// the new host is interned before the old one is released, so an unchanged host keeps its id
+void presenceCache::setHost(entry &e, std::string_view host) {
+    uint32_t id = host.empty() ? 0 : pool.intern(host);
+    if (e.host) pool.release(e.host);
+    e.host = id;
+}
+
+// what is known follows the nick, a watched nick keeps its own entry
+void presenceCache::rename(std::string_view from, std::string_view to) {
+    if (to.empty() || pool.equal(from, to)) return;
+    uint32_t id = pool.find(from);
+    auto it = entries.find(id);
+    if (!id || it == entries.end()) return;
+    entry copy = it->second;
+    // the copy's host must outlive the erase
+    if (copy.host) pool.retain(copy.host);
+    if (it->second.watched) {
+        it->second.online = NO;
+    } else {
+        erase(it);
+    }
+    entry *e = touch(to);
+    if (!e) {
+        if (copy.host) pool.release(copy.host);
+        return;
+    }
+    // takes over the reference retained above
+    if (e->host) pool.release(e->host);
+    e->host = copy.host;
+    set(e->user, copy.user);
+    set(e->account, copy.account);
+    set(e->realname, copy.realname);
+    set(e->awayMessage, copy.awayMessage);
+    e->seen = copy.seen;
+    e->refreshed = copy.refreshed;
+    e->away = copy.away;
+    e->online = YES;
+}
+
+void presenceCache::erase(std::unordered_map<uint32_t, entry>::iterator it) {
+    entry &e = it->second;
+    stats.bytes -= sizeof(entry) + sizeof(uint32_t) + 2 * sizeof(void *) + heapBytes(e.user) + heapBytes(e.account) +
+                   heapBytes(e.realname) + heapBytes(e.awayMessage);
+    if (e.monitored) monitoring--;
+    if (e.host) pool.release(e.host);
+    pool.release(it->first);
+    entries.erase(it);
+}
+
+// drops the entry of a user who left a channel, unless it is still shared, watched or looked up
+void presenceCache::left(std::string_view nick, roster &members) {
+    uint32_t id = pool.find(nick);
+    auto it = entries.find(id);
+    if (!id || it == entries.end()) return;
+    if (it->second.watched || it->second.wanted || members.shares(id)) return;
+    erase(it);
+}
+
+// after we left a channel, drops the entries that shared nothing else with us
+void presenceCache::sweep(roster &members) {
+    std::vector<uint32_t> gone;
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        if (!it->second.watched && !it->second.wanted && !members.shares(it->first)) gone.push_back(it->first);
+    }
+    for (auto it = gone.begin(); it != gone.end(); it++) erase(entries.find(*it));
+}
+
+// stale, and not already asked for within the stale period
+bool presenceCache::due(const entry &e, uint64_t nowMs) {
+    if (!staleMs || nowMs - e.refreshed < staleMs) return false;
+    return e.asked <= e.refreshed || nowMs - e.asked >= staleMs;
+}
+
+// down to three quarters of the budget, least recently seen first
+void presenceCache::evict() {
+    if (!stats.budget || stats.bytes <= stats.budget) return;
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+        if (!it->second.watched) order.push_back({it->second.seen, it->first});
+    }
+    std::sort(order.begin(), order.end());
+    for (auto it = order.begin(); it != order.end() && stats.bytes > stats.budget / 4 * 3; it++) {
+        erase(entries.find(it->second));
+        stats.evicted++;
+    }
+}
+
+// MONITOR=<limit> from 005, 0 without MONITOR, no limit if the value is empty
+size_t presenceCache::monitorLimit(const isupport &settings) {
+    auto found = settings.tokens.find("MONITOR");
+    if (found == settings.tokens.end()) return 0;
+    return found->second.size() ? (size_t)std::strtoul(found->second.c_str(), nullptr, 10) : (size_t)-1;
+}
+
+// "<command> a,b,c" lines of at most room bytes
+void presenceCache::pack(std::vector<std::string> &out, const char *command, const argList &items, size_t room) {
+    std::string line;
+    for (auto it = items.begin(); it != items.end(); it++) {
+        if (line.size() && line.size() + 1 + it->size() > room) {
+            out.push_back(line);
+            line.clear();
+        }
+        line += line.size() ? "," : std::string(command) + " ";
+        line.append(it->data(), it->size());
+    }
+    if (line.size()) out.push_back(line);
+}
@@ -0,0 +1,284 @@
+#include "../include/registration.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+static const char *stateNames[] = {"disconnected", "connecting", "open", "registering", "registered"};
+
+// commands that may go out between the socket opening and 001
+static const char *registrationCommands[] = {"PASS", "CAP", "NICK", "USER", "PONG", "PING", "QUIT", "AUTHENTICATE"};
+
+static bool equalNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::toupper((unsigned char)a[i]) != std::toupper((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+// command word of an outgoing line, skipping a prefix if any
+static std::string_view commandOf(std::string_view line) {
+    if (line.size() && line[0] == ':') {
+        size_t space = line.find(' ');
+        line = (space == std::string_view::npos) ? "" : line.substr(space + 1);
+    }
+    return line.substr(0, line.find(' '));
+}
+
+registration::registration() {
+    current = DISCONNECTED;
+    attempts = 0;
+    negotiating = false;
+}
+
+/**
+ * @brief stores what the registration burst is built from, kept across reconnects
+ *
+ * @param username
+ * @param hostname
+ * @param servername
+ * @param realname
+ * @param nick
+ */
+void registration::identify(std::string username, std::string hostname, std::string servername, std::string realname, std::string nick) {
+    this->username = username;
+    this->hostname = hostname;
+    this->servername = servername;
+    this->realname = realname;
+    base = nick;
+    this->nick = nick;
+}
+
+void registration::setPassword(std::string pass) {
+    password = pass;
+}
+
+/**
+ * @brief capabilities requested when the server lists them, CAP END is sent right away if none is offered
+ *
+ * @param caps
+ */
+void registration::setCapabilities(std::vector<std::string> caps) {
+    wanted = caps;
+}
+
+/**
+ * @brief capabilities a client feature needs, requested along with those of setCapabilities
+ *
+ * @param caps
+ */
+void registration::setImplied(std::vector<std::string> caps) {
+    implied = caps;
+}
+
+bool registration::identified() {
+    return base.size();
+}
+
+/**
+ * @brief tells if the server acknowledged a capability on this connection
+ *
+ * @param cap
+ * @return true if it is enabled
+ */
+bool registration::enabled(std::string_view cap) const {
+    for (auto it = acked.begin(); it != acked.end(); it++) {
+        if (*it == cap) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief socket created, everything sent from now on waits for registration
+ */
+void registration::connecting() {
+    current = CONNECTING;
+    attempts = 0;
+    negotiating = false;
+    offered.clear();
+    acked.clear();
+}
+
+/**
+ * @brief socket open
+ *
+ * @return std::string registration burst if identify was already called, empty otherwise
+ */
+std::string registration::opened() {
+    current = OPEN;
+    return identified() ? start() : "";
+}
+
+/**
+ * @brief builds the registration burst, PASS, CAP LS, NICK and USER in one CRLF joined frame
+ *
+ * @return std::string
+ */
+std::string registration::start() {
+    std::string burst;
+    if (password.size()) burst += "PASS " + password + "\r\n";
+    burst += "CAP LS 302\r\n";
+    burst += "NICK " + base + "\r\n";
+    burst += "USER " + username + " " + hostname + " " + servername + " :" + realname;
+    nick = base;
+    attempts = 0;
+    negotiating = true;
+    current = REGISTERING;
+    return burst;
+}
+
+/**
+ * @brief socket closed, held lines are dropped
+ */
+void registration::closed() {
+    current = DISCONNECTED;
+    user.clear();
+    host.clear();
+    negotiating = false;
+    held.clear();
+    offered.clear();
+    acked.clear();
+}
+
+/**
+ * @brief tells if a line has to wait for 001.
+ * Nothing is held while disconnected so controllers without a socket (native tools) send right away
+ *
+ * @param line
+ * @return true if the line should be held
+ */
+bool registration::holds(std::string_view line) {
+    if (current == DISCONNECTED || current == REGISTERED) return false;
+    if (current == CONNECTING) return true;
+    std::string_view command = commandOf(line);
+    for (size_t i = 0; i < sizeof(registrationCommands) / sizeof(*registrationCommands); i++) {
+        if (equalNoCase(command, registrationCommands[i])) return false;
+    }
+    return true;
+}
+
+void registration::hold(std::string line) {
+    held.push_back(std::move(line));
+}
+
+/**
+ * @brief moves the held lines out, for a reconnect to send them once registered again
+ *
+ * @param out lines are appended
+ */
+void registration::takeHeld(std::vector<std::string> &out) {
+    for (auto it = held.begin(); it != held.end(); it++) out.push_back(std::move(*it));
+    held.clear();
+}
+
+/**
+ * @brief follows the registration replies, CAP negotiation, nick collisions and 001
+ *
+ * @param m
+ * @return std::string lines to send right away, CRLF joined, empty if none
+ */
+std::string registration::offer(message &m) {
+    if (current == REGISTERED) {
+        if (equalNoCase(m.nick, nick) && m.host.size()) {
+            // our own JOIN, NICK... shows the prefix everyone else sees
+            user = m.user;
+            host = m.host;
+        }
+        // keep track of our own nick changes
+        if (m.command == "NICK" && equalNoCase(m.nick, nick)) nick = m.middle.size() ? m.middle[0] : m.trailing;
+        // RPL_VISIBLEHOST, <me> <host> :is now your displayed host
+        if (m.command == "396" && m.middle.size() >= 2) host = m.middle[1];
+        return "";
+    }
+    if (current != REGISTERING) return "";
+
+    if (m.command == "CAP" && negotiating && m.middle.size() >= 2) {
+        std::string sub = m.middle[1];
+        if (sub == "LS") {
+            size_t start = 0;
+            while (start < m.trailing.size()) {
+                size_t end = m.trailing.find(' ', start);
+                if (end == std::string::npos) end = m.trailing.size();
+                std::string cap = m.trailing.substr(start, end - start);
+                if (cap.size()) offered.push_back(cap.substr(0, cap.find('=')));
+                start = end + 1;
+            }
+            // CAP LS 302 replies are continued with "*" before the list
+            if (m.middle.size() > 2 && m.middle[2] == "*") return "";
+            std::string req;
+            std::vector<std::string> asked(wanted);
+            asked.insert(asked.end(), implied.begin(), implied.end());
+            for (auto it = asked.begin(); it != asked.end(); it++) {
+                // each once, a cap may be both wanted and implied
+                if (std::find(asked.begin(), it, *it) != it) continue;
+                for (auto off = offered.begin(); off != offered.end(); off++) {
+                    if (*off != *it) continue;
+                    req += (req.size() ? " " : "") + *it;
+                    break;
+                }
+            }
+            return req.size() ? "CAP REQ :" + req : endCaps();
+        }
+        if (sub == "ACK") {
+            size_t start = 0;
+            while (start < m.trailing.size()) {
+                size_t end = m.trailing.find(' ', start);
+                if (end == std::string::npos) end = m.trailing.size();
+                std::string cap = m.trailing.substr(start, end - start);
+                // "-cap" turns one off
+                if (cap.size() && cap[0] != '-') acked.push_back(cap);
+                start = end + 1;
+            }
+        }
+        if (sub == "ACK" || sub == "NAK") return endCaps();
+        return "";
+    }
+
+    if (m.command == "001") {
+        current = REGISTERED;
+        negotiating = false;
+        if (m.middle.size()) nick = m.middle[0];
+        return flush();
+    }
+
+    // nick taken or unavailable, 432 only if the rejected nick is one we made up
+    if (m.command == "433" || m.command == "437" || (m.command == "432" && attempts)) {
+        std::string next = alternativeNick();
+        if (next.empty()) return "";
+        nick = next;
+        return "NICK " + next;
+    }
+    return "";
+}
+
+/**
+ * @brief
+ *
+ * @return const char* "disconnected", "connecting", "open", "registering" or "registered"
+ */
+const char *registration::stateName() {
+    return stateNames[current];
+}
+
+// JohnDoe_, JohnDoe__, JohnDoe3 ... JohnDoe9 then gives up
+std::string registration::alternativeNick() {
+    attempts++;
+    if (attempts > 9) return "";
+    if (attempts <= 2) return base + std::string(attempts, '_');
+    return base.substr(0, 7) + std::to_string(attempts);
+}
+
+std::string registration::endCaps() {
+    negotiating = false;
+    return "CAP END";
+}
+
+std::string registration::flush() {
+    std::string frame;
+    for (auto it = held.begin(); it != held.end(); it++) {
+        if (frame.size()) frame += "\r\n";
+        frame += *it;
+    }
+    held.clear();
+    return frame;
+}
@@ -0,0 +1,375 @@
+#include "../include/requestTracker.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <map>
+
+// role of a numeric for a request type
+enum { UNRELATED,
+       REPLY,
+       END,
+       FAILURE };
+
+static const char *typeNames[] = {"whois", "names", "who", "motd", "list", "stats", "lusers"};
+
+static std::string lower(std::string s) {
+    for (auto it = s.begin(); it != s.end(); it++) *it = std::tolower(*it);
+    return s;
+}
+
+static std::vector<json11::Json> words(const std::string &text) {
+    std::vector<json11::Json> out;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(' ', start);
+        if (end == std::string::npos) end = text.size();
+        if (end > start) out.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return out;
+}
+
+static std::string param(message &m, size_t i) {
+    return i < m.middle.size() ? m.middle[i] : "";
+}
+
+static std::string last(message &m) {
+    return m.middle.size() ? m.middle.back() : "";
+}
+
+requestTracker::requestTracker() {
+    nextId = 1;
+}
+
+/**
+ * @brief registers a request whose replies should be collected
+ *
+ * @param type
+ * @param keys nicks (WHOIS) or channels (NAMES) asked for, one end numeric is expected per key
+ * @param nowMs monotonic ms, see expire
+ * @return uint32_t handle the result will carry as "id"
+ */
+uint32_t requestTracker::open(kind type, std::vector<std::string> keys, uint64_t nowMs) {
+    pending p;
+    p.id = nextId++;
+    p.type = type;
+    for (auto it = keys.begin(); it != keys.end(); it++) p.keys.push_back(lower(*it));
+    p.remaining = (type == WHOIS || type == NAMES) && keys.size() ? keys.size() : 1;
+    p.bytes = p.rows = 0;
+    p.delivered = false;
+    p.active = nowMs;
+    requests.push_back(p);
+    return p.id;
+}
+
+/**
+ * @brief classifies a numeric for a request type
+ *
+ * @param type
+ * @param numeric
+ * @return int REPLY, END, FAILURE or UNRELATED
+ */
+int requestTracker::role(kind type, int numeric) {
+    switch (type) {
+        case WHOIS:
+            if (numeric == 318) return END;
+            if (numeric == 402 || numeric == 431 || numeric == 461) return FAILURE;
+            if (numeric == 301 || numeric == 276 || numeric == 307 || (numeric >= 311 && numeric <= 313) ||
+                numeric == 317 || numeric == 319 || numeric == 320 || numeric == 330 || numeric == 338 ||
+                numeric == 378 || numeric == 379 || numeric == 401 || numeric == 671)
+                return REPLY;
+            return UNRELATED;
+        case NAMES:
+            if (numeric == 366) return END;
+            return numeric == 353 ? REPLY : UNRELATED;
+        case WHO:
+            if (numeric == 315) return END;
+            if (numeric == 263) return FAILURE;
+            return (numeric == 352 || numeric == 354) ? REPLY : UNRELATED;
+        case MOTD:
+            if (numeric == 376) return END;
+            if (numeric == 422 || numeric == 402) return FAILURE;
+            return (numeric == 375 || numeric == 372) ? REPLY : UNRELATED;
+        case LIST:
+            if (numeric == 323) return END;
+            if (numeric == 263 || numeric == 481) return FAILURE;
+            return (numeric == 321 || numeric == 322) ? REPLY : UNRELATED;
+        case STATS:
+            if (numeric == 219) return END;
+            if (numeric == 481 || numeric == 402) return FAILURE;
+            return (numeric >= 211 && numeric <= 250) ? REPLY : UNRELATED;
+        case LUSERS:
+            if (numeric == 266) return END;
+            if (numeric == 402) return FAILURE;
+            return ((numeric >= 251 && numeric <= 255) || numeric == 265) ? REPLY : UNRELATED;
+    }
+    return UNRELATED;
+}
+
+/**
+ * @brief target a reply is about, used to match WHOIS and NAMES replies to the request that asked
+ *
+ * @param type
+ * @param numeric
+ * @param m
+ * @return std::string lowercased nick or channel, empty if the reply carries none
+ */
+std::string requestTracker::keyOf(kind type, int numeric, message &m) {
+    if (type == WHOIS) return lower(param(m, 1));
+    if (type == NAMES) return lower(numeric == 353 ? last(m) : param(m, 1));
+    return "";
+}
+
+/**
+ * @brief hands a received message to the oldest matching request
+ *
+ * @param m
+ * @param nowMs monotonic ms, keeps the request alive
+ * @return true if the message was consumed by a request
+ * @return false if nobody asked for it
+ */
+bool requestTracker::offer(message &m, uint64_t nowMs) {
+    if (requests.empty() || m.command.size() != 3 || !std::isdigit(m.command[0])) return false;
+    int numeric = std::atoi(m.command.c_str());
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending &p = requests[i];
+        int r = role(p.type, numeric);
+        if (r == UNRELATED) continue;
+        if (r != FAILURE && p.keys.size() && m.middle.size() > 1) {
+            std::string key = keyOf(p.type, numeric, m);
+            bool match = key.empty();
+            for (auto it = p.keys.begin(); it != p.keys.end() && !match; it++) match = (*it == key);
+            if (!match) continue;
+        }
+
+        p.active = nowMs;
+        if (r == FAILURE) {
+            p.error = m.trailing;
+            complete(i, false);
+        } else if (r == END) {
+            if (--p.remaining == 0) complete(i, false);
+        } else if (p.type == LIST && numeric == 322) {
+            p.rows++;
+        } else if (!p.delivered) {
+            size_t size = m.memorySize();
+            p.bytes += size;
+            stats.bytes += size;
+            p.replies.push_back(std::move(m));
+            if (stats.budget && p.bytes > stats.budget) complete(i, true);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief fails a request that got nothing for idleMs, so an end numeric that never comes does not leave it
+ * taking replies meant for later requests
+ *
+ * @param id
+ * @param nowMs monotonic ms
+ * @param idleMs
+ * @return uint64_t ms until the request may expire, 0 once it is done or failed
+ */
+uint64_t requestTracker::expire(uint32_t id, uint64_t nowMs, uint64_t idleMs) {
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending &p = requests[i];
+        if (p.id != id) continue;
+        if (nowMs - p.active < idleMs) return idleMs - (nowMs - p.active);
+        p.error = "timed out";
+        complete(i, false);
+        return 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief fails every pending request with the same error, when the connection they were sent on is gone
+ *
+ * @param reason
+ */
+void requestTracker::failAll(std::string reason) {
+    while (requests.size()) {
+        requests.front().error = reason;
+        complete(0, false);
+    }
+}
+
+bool requestTracker::hasResult() {
+    return results.size();
+}
+
+/**
+ * @brief pops next completed request
+ *
+ * @return std::string json {"id", "type", "ok", "error", "truncated", "result"}, empty if none
+ */
+std::string requestTracker::nextResult() {
+    if (results.empty()) return "";
+    std::string ret = std::move(results.front());
+    results.pop_front();
+    return ret;
+}
+
+/**
+ * @brief caps the bytes a single request may collect, past it the request is delivered early as truncated
+ *
+ * @param bytes 0 for unbounded
+ */
+void requestTracker::setBudget(size_t bytes) {
+    stats.budget = bytes;
+}
+
+memoryUsage requestTracker::usage() {
+    memoryUsage ret = stats;
+    ret.count = requests.size();
+    for (auto it = results.begin(); it != results.end(); it++) ret.bytes += heapBytes(*it);
+    return ret;
+}
+
+void requestTracker::complete(size_t index, bool truncated) {
+    pending &p = requests[index];
+    if (p.delivered) {
+        requests.erase(requests.begin() + index);
+        return;
+    }
+    json11::Json result = json11::Json::object{
+        {"id", (double)p.id},
+        {"type", typeNames[p.type]},
+        {"ok", p.error.empty()},
+        {"error", p.error},
+        {"truncated", truncated},
+        {"result", aggregate(p)}};
+    results.push_back(result.dump());
+    stats.bytes -= p.bytes;
+    if (!truncated) {
+        requests.erase(requests.begin() + index);
+        return;
+    }
+    // keep swallowing the rest of the burst until its end numeric
+    stats.evicted++;
+    std::vector<message>().swap(p.replies);
+    p.bytes = 0;
+    p.delivered = true;
+}
+
+/**
+ * @brief builds the structured result out of the collected replies
+ *
+ * @param p
+ * @return json11::Json
+ */
+json11::Json requestTracker::aggregate(pending &p) {
+    switch (p.type) {
+        case WHOIS: {
+            std::map<std::string, json11::Json::object> users;
+            std::map<std::string, json11::Json::array> extras;
+            std::vector<std::string> order;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                message &m = *it;
+                std::string nick = param(m, 1);
+                if (!users.count(nick)) {
+                    order.push_back(nick);
+                    users[nick]["nick"] = nick;
+                    users[nick]["found"] = true;
+                }
+                json11::Json::object &u = users[nick];
+                int numeric = std::atoi(m.command.c_str());
+                if (numeric == 311) {
+                    u["user"] = param(m, 2);
+                    u["host"] = param(m, 3);
+                    u["realname"] = m.trailing;
+                } else if (numeric == 312) {
+                    u["server"] = param(m, 2);
+                    u["serverInfo"] = m.trailing;
+                } else if (numeric == 313) {
+                    u["operator"] = true;
+                } else if (numeric == 317) {
+                    u["idle"] = std::atof(param(m, 2).c_str());
+                    u["signon"] = std::atof(param(m, 3).c_str());
+                } else if (numeric == 319) {
+                    u["channels"] = words(m.trailing);
+                } else if (numeric == 301) {
+                    u["away"] = m.trailing;
+                } else if (numeric == 330) {
+                    u["account"] = param(m, 2);
+                } else if (numeric == 671) {
+                    u["secure"] = true;
+                } else if (numeric == 401) {
+                    u["found"] = false;
+                } else {
+                    extras[nick].push_back(m.trailing);
+                }
+            }
+            json11::Json::array list;
+            for (auto it = order.begin(); it != order.end(); it++) {
+                if (extras.count(*it)) users[*it]["extra"] = extras[*it];
+                list.push_back(users[*it]);
+            }
+            return json11::Json::object{{"users", list}};
+        }
+        case NAMES: {
+            std::map<std::string, json11::Json::array> chans;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                json11::Json::array &members = chans[last(*it)];
+                std::vector<json11::Json> nicks = words(it->trailing);
+                members.insert(members.end(), nicks.begin(), nicks.end());
+            }
+            json11::Json::object ret;
+            for (auto it = chans.begin(); it != chans.end(); it++) ret[it->first] = it->second;
+            return json11::Json::object{{"channels", ret}};
+        }
+        case WHO: {
+            json11::Json::array users;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                message &m = *it;
+                if (m.command == "354") {
+                    json11::Json::array fields(m.middle.begin() + 1, m.middle.end());
+                    if (m.trailing.size()) fields.push_back(m.trailing);
+                    users.push_back(json11::Json::object{{"fields", fields}});
+                    continue;
+                }
+                size_t space = m.trailing.find(' ');
+                users.push_back(json11::Json::object{
+                    {"channel", param(m, 1)},
+                    {"user", param(m, 2)},
+                    {"host", param(m, 3)},
+                    {"server", param(m, 4)},
+                    {"nick", param(m, 5)},
+                    {"flags", param(m, 6)},
+                    {"hops", std::atof(m.trailing.c_str())},
+                    {"realname", space == std::string::npos ? "" : m.trailing.substr(space + 1)}});
+            }
+            return json11::Json::object{{"users", users}};
+        }
+        case MOTD: {
+            json11::Json::array lines;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                if (it->command != "372") continue;
+                lines.push_back(it->trailing.compare(0, 2, "- ") ? it->trailing : it->trailing.substr(2));
+            }
+            return json11::Json::object{{"lines", lines}};
+        }
+        case LIST:
+            return json11::Json::object{{"count", (double)p.rows}};
+        case STATS: {
+            json11::Json::array lines;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                json11::Json::array params(it->middle.begin() + (it->middle.size() ? 1 : 0), it->middle.end());
+                lines.push_back(json11::Json::object{
+                    {"numeric", it->command},
+                    {"params", params},
+                    {"text", it->trailing}});
+            }
+            return json11::Json::object{{"lines", lines}};
+        }
+        case LUSERS: {
+            json11::Json::object counts;
+            for (auto it = p.replies.begin(); it != p.replies.end(); it++) {
+                counts[it->command] = it->trailing;
+            }
+            return counts;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,329 @@
+#include "../include/roster.hpp"
+
+#include <algorithm>
+#include <vector>
+
+roster::roster(internPool &pool) : pool(pool) {
+    prefixes = "~&@%+";
+    activity = 0;
+}
+
+/**
+ * @brief follows membership changes
+ *
+ * @param m
+ * @param ownNick our own leaving or joining adds or drops the whole channel
+ */
+void roster::offer(message &m, const std::string &ownNick) {
+    const std::string &first = m.middle.size() ? m.middle[0] : m.trailing;
+    bool self = pool.equal(m.nick, ownNick);
+
+    if (m.command == "JOIN") {
+        if (self && !find(first)) {
+            uint32_t id = pool.intern(first);
+            if (id) channels[id];
+        }
+        channel *c = find(first);
+        if (c) add(*c, m.nick, {0, ++activity});
+    } else if (m.command == "PART") {
+        uint32_t id = pool.find(first);
+        if (!channels.count(id)) return;
+        if (self) return drop(id);
+        remove(channels[id], pool.find(m.nick));
+    } else if (m.command == "KICK") {
+        uint32_t id = pool.find(first);
+        if (!channels.count(id) || m.middle.size() < 2) return;
+        if (pool.equal(m.middle[1], ownNick)) return drop(id);
+        remove(channels[id], pool.find(m.middle[1]));
+    } else if (m.command == "QUIT") {
+        uint32_t nick = pool.find(m.nick);
+        if (!nick) return;
+        for (auto it = channels.begin(); it != channels.end(); it++) remove(it->second, nick);
+    } else if (m.command == "NICK") {
+        uint32_t old = pool.find(m.nick);
+        if (!old || first.empty()) return;
+        if (pool.equal(m.nick, first)) return pool.respell(old, first);
+        for (auto it = channels.begin(); it != channels.end(); it++) {
+            auto member = it->second.members.find(old);
+            if (member == it->second.members.end()) continue;
+            roster::member state = member->second;
+            remove(it->second, old);
+            add(it->second, first, state);
+        }
+    } else if (m.command == "353" && m.middle.size() >= 3) {
+        // <me> <type> <channel> :[prefixes]nick[!user@host] ...
+        channel *c = find(m.middle.back());
+        if (!c) return;
+        if (!c->syncing) {
+            // a new NAMES burst replaces what we knew
+            for (auto it = c->members.begin(); it != c->members.end(); it++) pool.release(it->first);
+            c->members.clear();
+            c->index.clear();
+            c->syncing = true;
+            c->stale = true;
+        }
+        const std::string &t = m.trailing;
+        size_t start = 0;
+        while (start < t.size()) {
+            size_t end = t.find(' ', start);
+            if (end == std::string::npos) end = t.size();
+            uint8_t modes = 0;
+            size_t p = start, bit;
+            while (p < end && (bit = prefixes.find(t[p])) != std::string::npos) {
+                if (bit < 8) modes |= 1 << bit;
+                p++;
+            }
+            size_t bang = t.find('!', p);
+            if (p < end) add(*c, std::string_view(t).substr(p, std::min(bang, end) - p), {modes, 0});
+            start = end + 1;
+        }
+    } else if (m.command == "366" && m.middle.size() >= 2) {
+        // sorted while the burst is handled rather than on the first keystroke
+        channel *c = find(m.middle[1]);
+        if (c) c->syncing = false;
+        if (c && c->stale) sort(*c);
+    } else if ((m.command == "PRIVMSG" || m.command == "NOTICE") && m.nick.size()) {
+        touch(first, m.nick);
+    }
+}
+
+/**
+ * @brief
+ *
+ * @param channel
+ * @return true if we are in the channel
+ */
+bool roster::has(std::string_view channel) {
+    return find(channel);
+}
+
+/**
+ * @brief channels we share with a nick
+ *
+ * @param nick pool id
+ * @param out replaced with channel ids
+ */
+void roster::channelsOf(uint32_t nick, std::vector<uint32_t> &out) {
+    out.clear();
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        if (it->second.members.count(nick)) out.push_back(it->first);
+    }
+}
+
+/**
+ * @brief
+ *
+ * @param nick pool id
+ * @return true if the nick is in at least one of our channels
+ */
+bool roster::shares(uint32_t nick) {
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        if (it->second.members.count(nick)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief
+ *
+ * @param channel pool id
+ * @return size_t members known, 0 if not joined
+ */
+size_t roster::count(uint32_t channel) {
+    auto it = channels.find(channel);
+    return it == channels.end() ? 0 : it->second.members.size();
+}
+
+/**
+ * @brief members of a channel we are in, highest prefix first then by name
+ *
+ * @param channel
+ * @return std::string json array of nicks carrying their highest prefix, "[]" if not joined
+ */
+std::string roster::members(std::string channel) {
+    roster::channel *c = find(channel);
+    if (!c) return "[]";
+    std::vector<std::pair<uint8_t, std::string_view>> list;
+    list.reserve(c->members.size());
+    for (auto it = c->members.begin(); it != c->members.end(); it++) {
+        // lowest set bit is the highest prefix, 8 sorts members without one last
+        uint8_t rank = it->second.modes ? __builtin_ctz(it->second.modes) : 8;
+        list.push_back({rank, pool.view(it->first)});
+    }
+    std::sort(list.begin(), list.end());
+    json11::Json::array ret;
+    for (auto it = list.begin(); it != list.end(); it++) {
+        std::string nick = it->first < prefixes.size() ? std::string(1, prefixes[it->first]) : "";
+        ret.push_back(nick.append(it->second));
+    }
+    return json11::Json(ret).dump();
+}
+
+/**
+ * @brief nicks of a channel starting with prefix under the casemapping, for tab completion and mentions.
+ * A binary search over the sorted index finds the matches, the most recently active come first then by name
+ *
+ * @param channel
+ * @param prefix may be empty to rank every member
+ * @param limit 0 for every match
+ * @return std::string json array of nicks, "[]" if not in the channel
+ */
+std::string roster::complete(std::string_view channel, std::string_view prefix, size_t limit) {
+    roster::channel *c = find(channel);
+    if (!c) return "[]";
+    if (c->stale) sort(*c);
+    std::vector<std::pair<uint32_t, uint32_t>> matches;  // activity, nick id
+    for (auto it = position(*c, prefix); it != c->index.end(); it++) {
+        std::string_view nick = pool.view(*it);
+        if (nick.size() < prefix.size() || !pool.equal(nick.substr(0, prefix.size()), prefix)) break;
+        matches.push_back({c->members[*it].active, *it});
+    }
+    if (!limit || limit > matches.size()) limit = matches.size();
+    // matches are in name order already, a stable sort keeps it among equal activity
+    std::stable_sort(matches.begin(), matches.end(), [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) { return a.first > b.first; });
+    json11::Json::array ret;
+    for (size_t i = 0; i < limit; i++) ret.push_back(pool.name(matches[i].second));
+    return json11::Json(ret).dump();
+}
+
+/**
+ * @brief membership prefix symbols as advertised by the server, highest first
+ *
+ * @param symbols e.g. "~&@%+"
+ */
+void roster::setPrefixes(std::string symbols) {
+    prefixes = symbols.substr(0, 8);
+}
+
+/**
+ * @brief completion indexes are sorted again on next use, for a changed casemapping
+ */
+void roster::reindex() {
+    for (auto it = channels.begin(); it != channels.end(); it++) it->second.stale = true;
+}
+
+/**
+ * @brief forgets every channel, for a closed connection
+ */
+void roster::clear() {
+    while (channels.size()) drop(channels.begin()->first);
+}
+
+/**
+ * @brief writes every channel with its members, modes and activity, as pool ids
+ *
+ * @param s
+ */
+void roster::save(snapshot &s) {
+    s.putString(prefixes);
+    s.putVarint(activity);
+    s.putVarint(channels.size());
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        s.putVarint(it->first);
+        s.putVarint(it->second.members.size());
+        for (auto member = it->second.members.begin(); member != it->second.members.end(); member++) {
+            s.putVarint(member->first);
+            s.putVarint(member->second.modes);
+            s.putVarint(member->second.active);
+        }
+    }
+}
+
+/**
+ * @brief replaces every channel with saved ones.
+ * The references they hold come back with the pool, restore the pool first
+ *
+ * @param s
+ * @return true
+ * @return false if the image is damaged
+ */
+bool roster::restore(snapshot &s) {
+    channels.clear();
+    prefixes = s.getString();
+    activity = (uint32_t)s.getVarint();
+    size_t count = s.getVarint();
+    for (size_t i = 0; i < count && s.ok(); i++) {
+        channel &c = channels[(uint32_t)s.getVarint()];
+        size_t members = s.getVarint();
+        for (size_t k = 0; k < members && s.ok(); k++) {
+            uint32_t id = (uint32_t)s.getVarint();
+            uint8_t modes = (uint8_t)s.getVarint();
+            c.members[id] = {modes, (uint32_t)s.getVarint()};
+        }
+        sort(c);
+    }
+    if (!s.ok()) channels.clear();
+    return s.ok();
+}
+
+memoryUsage roster::usage() {
+    memoryUsage ret;
+    ret.count = channels.size();
+    ret.bytes = channels.bucket_count() * sizeof(void *);
+    for (auto it = channels.begin(); it != channels.end(); it++) {
+        ret.bytes += sizeof(*it) + it->second.members.bucket_count() * sizeof(void *) +
+                     it->second.members.size() * (sizeof(std::pair<uint32_t, member>) + 2 * sizeof(void *)) + heapBytes(it->second.index);
+    }
+    return ret;
+}
+
+roster::channel *roster::find(std::string_view name) {
+    auto it = channels.find(pool.find(name));
+    return it == channels.end() ? nullptr : &it->second;
+}
+
+void roster::add(channel &c, std::string_view nick, member state) {
+    uint32_t id = pool.intern(nick);
+    if (!id) return;
+    auto inserted = c.members.emplace(id, state);
+    // already a member, keep a single reference
+    if (!inserted.second) {
+        inserted.first->second.modes |= state.modes;
+        inserted.first->second.active = std::max(inserted.first->second.active, state.active);
+        pool.release(id);
+        return;
+    }
+    // a NAMES burst is sorted once on the next completion instead of one insert at a time
+    if (c.syncing) c.stale = true;
+    if (!c.stale) c.index.insert(position(c, pool.view(id)), id);
+}
+
+void roster::remove(channel &c, uint32_t nick) {
+    if (!c.members.erase(nick)) return;
+    if (!c.stale) {
+        auto it = position(c, pool.view(nick));
+        if (it != c.index.end() && *it == nick) c.index.erase(it);
+    }
+    pool.release(nick);
+}
+
+// a message to a channel moves its sender up the completion ranking
+void roster::touch(std::string_view channel, std::string_view nick) {
+    roster::channel *c = find(channel);
+    if (!c) return;
+    auto member = c->members.find(pool.find(nick));
+    if (member != c->members.end()) member->second.active = ++activity;
+}
+
+// rebuilds the completion index from the member map
+void roster::sort(channel &c) {
+    c.index.clear();
+    c.index.reserve(c.members.size());
+    for (auto it = c.members.begin(); it != c.members.end(); it++) c.index.push_back(it->first);
+    std::sort(c.index.begin(), c.index.end(), [this](uint32_t a, uint32_t b) { return pool.compare(pool.view(a), pool.view(b)) < 0; });
+    c.stale = false;
+}
+
+// first index entry not sorting before nick
+std::vector<uint32_t>::iterator roster::position(channel &c, std::string_view nick) {
+    return std::lower_bound(c.index.begin(), c.index.end(), nick, [this](uint32_t id, std::string_view name) { return pool.compare(pool.view(id), name) < 0; });
+}
+
+// leaves a channel, releasing every member and the channel name
+void roster::drop(uint32_t id) {
+    auto it = channels.find(id);
+    if (it == channels.end()) return;
+    for (auto member = it->second.members.begin(); member != it->second.members.end(); member++) pool.release(member->first);
+    channels.erase(it);
+    pool.release(id);
+}
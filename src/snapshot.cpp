@@ -0,0 +1,142 @@
+#include "../include/snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "../include/varint.hpp"
+
+static const char MAGIC[8] = {'I', 'R', 'C', 'S', 'N', 'P', '0', '1'};
+static const uint32_t ORDER_MARK = 0x01020304;
+
+snapshot::snapshot() {
+    clear();
+}
+
+/**
+ * @brief empties the image, for a new save
+ */
+void snapshot::clear() {
+    body.clear();
+    read = 0;
+    failed = false;
+}
+
+/**
+ * @brief writes the image in one go next to path then moves it over, a reload never sees half a snapshot.
+ * In the browser path lives on an IDBFS mount, FS.syncfs persists it
+ *
+ * @param path
+ * @return true
+ * @return false if the file could not be written
+ */
+bool snapshot::save(std::string path) {
+    std::string header(MAGIC, sizeof(MAGIC));
+    // the raw tables are only valid on a host with the same byte order
+    uint32_t order = ORDER_MARK;
+    header.append((const char *)&order, sizeof(order));
+    appendVarint(header, body.size());
+
+    std::string temp = path + ".tmp";
+    FILE *file = std::fopen(temp.c_str(), "wb");
+    if (!file) return false;
+    bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                   std::fwrite(body.data(), 1, body.size(), file) == body.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief reads a whole snapshot into memory, checking magic, byte order and length
+ *
+ * @param path
+ * @return true
+ * @return false if missing, from another version or truncated
+ */
+bool snapshot::load(std::string path) {
+    clear();
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::string data;
+    char buf[65536];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), file)) > 0) data.append(buf, n);
+    std::fclose(file);
+
+    if (data.size() < sizeof(MAGIC) || std::memcmp(data.data(), MAGIC, sizeof(MAGIC))) return false;
+    body = data.substr(sizeof(MAGIC));
+    uint32_t order = 0;
+    uint64_t length = getBlob(&order, sizeof(order)) ? getVarint() : 0;
+    if (failed || order != ORDER_MARK || body.size() - read != length) {
+        clear();
+        return false;
+    }
+    body.erase(0, read);
+    read = 0;
+    return true;
+}
+
+/**
+ * @brief
+ *
+ * @return true while every read stayed inside the image
+ */
+bool snapshot::ok() {
+    return !failed;
+}
+
+size_t snapshot::size() {
+    return body.size();
+}
+
+void snapshot::putVarint(uint64_t value) {
+    appendVarint(body, value);
+}
+
+void snapshot::putString(std::string_view value) {
+    putVarint(value.size());
+    body.append(value.data(), value.size());
+}
+
+void snapshot::putBlob(const void *data, size_t bytes) {
+    body.append((const char *)data, bytes);
+}
+
+uint64_t snapshot::getVarint() {
+    uint64_t value;
+    if (readVarint(body, read, value)) return value;
+    failed = true;
+    return 0;
+}
+
+std::string snapshot::getString() {
+    uint64_t length = getVarint();
+    if (failed || body.size() - read < length) {
+        failed = true;
+        return "";
+    }
+    std::string ret = body.substr(read, length);
+    read += length;
+    return ret;
+}
+
+/**
+ * @brief copies the next bytes out of the image
+ *
+ * @param data
+ * @param bytes
+ * @return true
+ * @return false if the image is shorter
+ */
+bool snapshot::getBlob(void *data, size_t bytes) {
+    if (failed || body.size() - read < bytes) {
+        failed = true;
+        return false;
+    }
+    if (bytes) std::memcpy(data, body.data() + read, bytes);
+    read += bytes;
+    return true;
+}
@@ -0,0 +1,245 @@
+#include "../include/targetRouter.hpp"
+
+#include <cctype>
+#include <cstring>
+
+static bool isNickChar(char c) {
+    return std::isalnum((unsigned char)c) || (c && std::strchr("-[]\\`^{}|_", c));
+}
+
+targetRouter::targetRouter(internPool &pool) : pool(pool) {
+}
+
+/**
+ * @brief files a PRIVMSG under its conversation
+ *
+ * @param m
+ * @param ownNick to tell private queries from channel messages and to count mentions
+ * @return true if the message was kept in a subscribed target's queue
+ * @return false if it was only counted
+ */
+bool targetRouter::route(message &&m, const std::string &ownNick) {
+    std::string_view name = m.middle.size() ? std::string_view(m.middle[0]) : std::string_view();
+    bool query = name.empty() || chantypes.find(name[0]) == std::string::npos;
+    // a query is filed under the other side, the sender unless we are the one talking
+    if (query && m.nick.size() && !pool.equal(m.nick, ownNick)) name = m.nick;
+    if (name.empty()) return false;
+
+    target &t = get(name);
+    if (t.subscribed) {
+        t.queue.push(std::move(m));
+        return true;
+    }
+    t.unread++;
+    if (query || mentions(m.trailing, ownNick)) t.mentions++;
+    return false;
+}
+
+/**
+ * @brief starts keeping messages of a target, its counters are cleared
+ *
+ * @param target channel or nick
+ * @return true
+ * @return false if already subscribed
+ */
+bool targetRouter::subscribe(std::string target) {
+    if (target.empty()) return false;
+    targetRouter::target &t = get(target);
+    if (t.subscribed) return false;
+    t.subscribed = true;
+    t.unread = t.mentions = 0;
+    subscribed++;
+    return true;
+}
+
+/**
+ * @brief stops keeping messages of a target, queued ones are dropped
+ *
+ * @param target
+ * @return true
+ * @return false if it was not subscribed
+ */
+bool targetRouter::unsubscribe(std::string target) {
+    auto found = targets.find(pool.find(target));
+    if (found == targets.end() || !found->second.subscribed) return false;
+    found->second.subscribed = false;
+    while (!found->second.queue.empty()) found->second.queue.pop();
+    subscribed--;
+    return true;
+}
+
+/**
+ * @brief routing only kicks in once something is subscribed, until then the caller keeps a single queue
+ *
+ * @return true if any target is subscribed
+ */
+bool targetRouter::active() {
+    return subscribed;
+}
+
+/**
+ * @brief prefixes that start a channel name, CHANTYPES from 005
+ *
+ * @param types
+ */
+void targetRouter::setChannelTypes(std::string types) {
+    chantypes = types;
+}
+
+/**
+ * @brief pops up to max messages of a subscribed target
+ *
+ * @param target
+ * @param max
+ * @return std::string json array of messages, "[]" if none
+ */
+std::string targetRouter::next(std::string target, size_t max) {
+    auto found = targets.find(pool.find(target));
+    if (found == targets.end()) return "[]";
+    messageQueue &q = found->second.queue;
+    std::string ret = "[";
+    for (size_t i = 0; i < max && !q.empty(); i++) {
+        if (i) ret += ",";
+        ret += q.front().asJson();
+        q.pop();
+    }
+    return ret + "]";
+}
+
+/**
+ * @brief pops up to max messages of a subscribed target into a batch of HTML
+ *
+ * @param target
+ * @param max
+ * @param ownNick lines we sent come back with echo-message, they are skipped as the UI shows them when sent
+ * @param out
+ * @return size_t messages popped
+ */
+size_t targetRouter::render(std::string target, size_t max, const std::string &ownNick, htmlRenderer &out) {
+    auto found = targets.find(pool.find(target));
+    if (found == targets.end()) return 0;
+    messageQueue &q = found->second.queue;
+    size_t i = 0;
+    for (; i < max && !q.empty(); i++) {
+        message &m = q.front();
+        if (m.command == "PRIVMSG" && m.nick.size() && !pool.equal(m.nick, ownNick)) out.line(m.nick, m.trailing, false);
+        q.pop();
+    }
+    return i;
+}
+
+/**
+ * @brief counters of targets that are not subscribed and got something since they were last viewed
+ *
+ * @return std::string json {"<target>": {"unread", "mentions"}}
+ */
+std::string targetRouter::unreadCounts() {
+    json11::Json::object ret;
+    for (auto it = targets.begin(); it != targets.end(); it++) {
+        if (!it->second.unread) continue;
+        ret[pool.name(it->first)] = json11::Json::object{
+            {"unread", (double)it->second.unread},
+            {"mentions", (double)it->second.mentions}};
+    }
+    return json11::Json(ret).dump();
+}
+
+/**
+ * @brief budget of each target's queue
+ *
+ * @param bytes 0 for unbounded
+ */
+void targetRouter::setBudget(size_t bytes) {
+    budget = bytes;
+    for (auto it = targets.begin(); it != targets.end(); it++) it->second.queue.setBudget(bytes);
+}
+
+memoryUsage targetRouter::usage() {
+    memoryUsage ret;
+    ret.budget = budget;
+    ret.count = targets.size();
+    ret.bytes = targets.bucket_count() * sizeof(void *);
+    for (auto it = targets.begin(); it != targets.end(); it++) {
+        memoryUsage q = it->second.queue.usage();
+        ret.bytes += sizeof(*it) + q.bytes;
+        ret.evicted += q.evicted;
+    }
+    return ret;
+}
+
+/**
+ * @brief forgets every target and its messages
+ */
+void targetRouter::clear() {
+    for (auto it = targets.begin(); it != targets.end(); it++) pool.release(it->first);
+    targets.clear();
+    subscribed = 0;
+}
+
+/**
+ * @brief writes every target, its counters and the newest queued messages
+ *
+ * @param s
+ * @param tail messages kept per target
+ */
+void targetRouter::save(snapshot &s, size_t tail) {
+    s.putString(chantypes);
+    s.putVarint(targets.size());
+    for (auto it = targets.begin(); it != targets.end(); it++) {
+        s.putVarint(it->first);
+        s.putVarint(it->second.unread);
+        s.putVarint(it->second.mentions);
+        s.putVarint(it->second.subscribed);
+        it->second.queue.save(s, tail);
+    }
+}
+
+/**
+ * @brief replaces every target with saved ones, restore the pool first as for the roster
+ *
+ * @param s
+ * @return true
+ * @return false if the image is damaged
+ */
+bool targetRouter::restore(snapshot &s) {
+    targets.clear();
+    subscribed = 0;
+    chantypes = s.getString();
+    size_t count = s.getVarint();
+    for (size_t i = 0; i < count && s.ok(); i++) {
+        target &t = targets[(uint32_t)s.getVarint()];
+        t.unread = (uint32_t)s.getVarint();
+        t.mentions = (uint32_t)s.getVarint();
+        t.subscribed = s.getVarint();
+        t.queue.setBudget(budget);
+        t.queue.restore(s);
+        if (t.subscribed) subscribed++;
+    }
+    if (!s.ok()) {
+        targets.clear();
+        subscribed = 0;
+    }
+    return s.ok();
+}
+
+// target of a name, created on first use
+targetRouter::target &targetRouter::get(std::string_view name) {
+    uint32_t id = pool.find(name);
+    auto found = targets.find(id);
+    if (found != targets.end()) return found->second;
+    target &t = targets[pool.intern(name)];
+    t.queue.setBudget(budget);
+    return t;
+}
+
+// nick as a whole word, case insensitive
+bool targetRouter::mentions(std::string_view text, const std::string &nick) {
+    if (nick.empty() || text.size() < nick.size()) return false;
+    for (size_t i = 0; i + nick.size() <= text.size(); i++) {
+        if (i && isNickChar(text[i - 1])) continue;
+        size_t k = 0;
+        while (k < nick.size() && std::tolower((unsigned char)text[i + k]) == std::tolower((unsigned char)nick[k])) k++;
+        if (k == nick.size() && (i + k == text.size() || !isNickChar(text[i + k]))) return true;
+    }
+    return false;
+}
@@ -0,0 +1,254 @@
+#include "../include/timerWheel.hpp"
+
+#include <algorithm>
+
+// bits of a slot mask rotated so that slot first comes out as bit 0
+static uint64_t rotate(uint64_t bits, unsigned first) {
+    return first ? (bits >> first) | (bits << (64 - first)) : bits;
+}
+
+timerWheel::timerWheel(uint64_t resolutionMs) {
+    resolution = resolutionMs ? resolutionMs : 1;
+    std::fill(heads, heads + levels * slots, 0);
+    std::fill(occupied, occupied + levels, 0);
+    current = 0;
+    count = 0;
+    started = false;
+}
+
+/**
+ * @brief runs a callback once, no earlier than delayMs from now
+ *
+ * @param nowMs monotonic clock
+ * @param delayMs
+ * @param callback may schedule and cancel timers, itself included
+ * @return uint64_t id for cancel, never 0
+ */
+uint64_t timerWheel::after(uint64_t nowMs, uint64_t delayMs, std::function<void()> callback) {
+    return schedule(nowMs, delayMs, 0, std::move(callback));
+}
+
+/**
+ * @brief runs a callback every periodMs, the first time one period from now.
+ * Periods missed while the host was not ticking are skipped, not run back to back
+ *
+ * @param nowMs
+ * @param periodMs
+ * @param callback
+ * @return uint64_t id for cancel, never 0
+ */
+uint64_t timerWheel::every(uint64_t nowMs, uint64_t periodMs, std::function<void()> callback) {
+    return schedule(nowMs, periodMs, periodMs ? periodMs : 1, std::move(callback));
+}
+
+/**
+ * @brief
+ *
+ * @param id from after or every, stale ids and 0 are ignored
+ * @return true if it was pending
+ */
+bool timerWheel::cancel(uint64_t id) {
+    if (!pending(id)) return false;
+    uint32_t index = (uint32_t)id - 1;
+    if (nodes[index].slot >= 0) unlink(index);
+    release(index);
+    return true;
+}
+
+bool timerWheel::pending(uint64_t id) {
+    uint32_t index = (uint32_t)id - 1;
+    return id && index < nodes.size() && nodes[index].live && nodes[index].generation == id >> 32;
+}
+
+/**
+ * @brief runs every timer due by now, ticks without anything to do are skipped over
+ *
+ * @param nowMs monotonic clock
+ * @return size_t callbacks run
+ */
+size_t timerWheel::advance(uint64_t nowMs) {
+    if (!started) {
+        start(nowMs);
+        return 0;
+    }
+    uint64_t target = nowMs / resolution;
+    size_t fired = 0;
+    while (current <= target) {
+        if (!(current & (slots - 1))) {
+            // a slot of level n comes up when the low n levels wrap, higher levels first so theirs land below
+            int top = 1;
+            while (top < levels - 1 && !((current >> (slotBits * top)) & (slots - 1))) top++;
+            for (int level = top; level >= 1; level--) cascade(level);
+        }
+        fired += fire();
+        uint64_t next = count ? nextTick() : target + 1;
+        if (next > current) current = std::min(next, target + 1);
+    }
+    return fired;
+}
+
+/**
+ * @brief when the host has to call advance next, the earliest timer or the earliest slot to move down a level
+ *
+ * @return uint64_t monotonic ms, 0 if no timer is pending
+ */
+uint64_t timerWheel::nextDue() {
+    return count ? nextTick() * resolution : 0;
+}
+
+size_t timerWheel::size() {
+    return count;
+}
+
+/**
+ * @brief cancels every timer, their ids stay stale
+ */
+void timerWheel::clear() {
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].live) release(i);
+    }
+    std::fill(heads, heads + levels * slots, 0);
+    std::fill(occupied, occupied + levels, 0);
+    for (auto it = nodes.begin(); it != nodes.end(); it++) it->slot = -1;
+}
+
+memoryUsage timerWheel::usage() {
+    memoryUsage ret;
+    ret.count = count;
+    ret.bytes = sizeof(heads) + heapBytes(nodes) + heapBytes(freeNodes) + heapBytes(firing);
+    return ret;
+}
+
+uint64_t timerWheel::schedule(uint64_t nowMs, uint64_t delayMs, uint64_t periodMs, std::function<void()> &&callback) {
+    start(nowMs);
+    uint32_t index;
+    if (freeNodes.size()) {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        nodes.emplace_back();
+        index = (uint32_t)nodes.size() - 1;
+        nodes[index].generation = 0;
+    }
+    timer &t = nodes[index];
+    t.callback = std::move(callback);
+    // rounded up, a timer never fires early
+    t.due = std::max(current, (nowMs + delayMs + resolution - 1) / resolution);
+    t.period = periodMs ? std::max<uint64_t>(1, (periodMs + resolution - 1) / resolution) : 0;
+    t.live = true;
+    count++;
+    link(index);
+    return (uint64_t)t.generation << 32 | (index + 1);
+}
+
+void timerWheel::start(uint64_t nowMs) {
+    if (started) return;
+    current = nowMs / resolution;
+    started = true;
+}
+
+// places a timer by how far away it is: level n holds what is due within 64^(n+1) ticks.
+// Anything further is parked in the last top level slot to come up and placed again from there
+void timerWheel::link(uint32_t index) {
+    timer &t = nodes[index];
+    uint64_t due = std::max(t.due, current);
+    uint64_t delta = due - current;
+    int level = 0;
+    while (level < levels - 1 && delta >> (slotBits * (level + 1))) level++;
+    if (delta >> (slotBits * levels)) due = current + ((uint64_t)1 << (slotBits * levels)) - 1;
+    int slot = (int)((due >> (slotBits * level)) & (slots - 1));
+    int16_t at = (int16_t)(level * slots + slot);
+    t.slot = at;
+    t.prev = 0;
+    t.next = heads[at];
+    if (heads[at]) nodes[heads[at] - 1].prev = index + 1;
+    heads[at] = index + 1;
+    occupied[level] |= (uint64_t)1 << slot;
+}
+
+void timerWheel::unlink(uint32_t index) {
+    timer &t = nodes[index];
+    if (t.prev) {
+        nodes[t.prev - 1].next = t.next;
+    } else {
+        heads[t.slot] = t.next;
+    }
+    if (t.next) nodes[t.next - 1].prev = t.prev;
+    if (!heads[t.slot]) occupied[t.slot / slots] &= ~((uint64_t)1 << (t.slot % slots));
+    t.slot = -1;
+}
+
+void timerWheel::release(uint32_t index) {
+    timer &t = nodes[index];
+    t.live = false;
+    t.callback = nullptr;
+    t.generation++;
+    freeNodes.push_back(index);
+    count--;
+}
+
+// moves the timers of the level's current slot down to where they belong now
+void timerWheel::cascade(int level) {
+    int at = level * slots + (int)((current >> (slotBits * level)) & (slots - 1));
+    uint32_t index = heads[at];
+    heads[at] = 0;
+    occupied[level] &= ~((uint64_t)1 << (at % slots));
+    while (index) {
+        uint32_t next = nodes[index - 1].next;
+        link(index - 1);
+        index = next;
+    }
+}
+
+// runs the level 0 slot of the current tick, which then counts as done
+size_t timerWheel::fire() {
+    int at = (int)(current & (slots - 1));
+    // taken out first, callbacks may cancel or add timers while the list is walked
+    firing.clear();
+    for (uint32_t index = heads[at]; index; index = nodes[index - 1].next) {
+        firing.push_back((uint64_t)nodes[index - 1].generation << 32 | index);
+        nodes[index - 1].slot = -1;
+    }
+    heads[at] = 0;
+    occupied[0] &= ~((uint64_t)1 << at);
+    uint64_t tick = current++;
+
+    size_t fired = 0;
+    for (size_t i = 0; i < firing.size(); i++) {
+        uint64_t id = firing[i];
+        if (!pending(id)) continue;
+        uint32_t index = (uint32_t)id - 1;
+        if (nodes[index].due > tick) {
+            link(index);
+            continue;
+        }
+        std::function<void()> callback = std::move(nodes[index].callback);
+        callback();
+        fired++;
+        // nodes may have grown, and the timer may have been cancelled
+        if (!pending(id)) continue;
+        timer &t = nodes[index];
+        if (t.period) {
+            t.callback = std::move(callback);
+            t.due = std::max(t.due + t.period, current);
+            link(index);
+        } else {
+            release(index);
+        }
+    }
+    return fired;
+}
+
+// earliest tick with something to do, a timer in level 0 or a slot above that moves down
+uint64_t timerWheel::nextTick() {
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < levels; level++) {
+        if (!occupied[level]) continue;
+        unsigned shift = slotBits * level;
+        // first tick at or after current where a slot of this level comes up
+        uint64_t base = (current + ((uint64_t)1 << shift) - 1) >> shift;
+        uint64_t bits = rotate(occupied[level], (unsigned)(base & (slots - 1)));
+        best = std::min(best, (base + __builtin_ctzll(bits)) << shift);
+    }
+    return best;
+}
@@ -0,0 +1,42 @@
+// Compares passing list arguments through the std::vector binding against bulk (one delimited string)
+// and bulkView (delimited bytes written straight into wasm memory).
+//
+//  usage: node tools/bench/args.js [items] [iterations]
+//
+// needs a build in ./wasm (make), no server connection is made
+const path = require('path');
+const Module = require(path.join(__dirname, '../../wasm/ircppwasm.js'));
+
+const items = parseInt(process.argv[2] || '5000', 10);
+const iterations = parseInt(process.argv[3] || '200', 10);
+
+function time(label, fn) {
+  for (let i = 0; i < 5; i++) fn();
+  const start = performance.now();
+  for (let i = 0; i < iterations; i++) fn();
+  const ms = (performance.now() - start) / iterations;
+  console.log(`${label.padEnd(10)} ${ms.toFixed(3)} ms/call  ${(items / ms / 1000).toFixed(2)} M items/s`);
+  return ms;
+}
+
+Module().then((module) => {
+  const irc = new module.ircController();
+  irc.setDebug(false);
+
+  const masks = [];
+  for (let i = 0; i < items; i++) masks.push(`user${i}@host${i}.example.net`);
+  const joined = masks.join('\n');
+  const encoder = new TextEncoder();
+  const maxBytes = joined.length * 3;
+
+  console.log(`${items} masks per call, ${iterations} calls`);
+  const vector = time('vector', () => irc.kline(masks, '', ''));
+  const bulk = time('bulk', () => irc.bulk('KLINE', joined, '', ''));
+  const view = time('bulkView', () => {
+    const buffer = irc.getArgBuffer(maxBytes);
+    const { written } = encoder.encodeInto(joined, buffer);
+    irc.bulkView('KLINE', written, '', '');
+  });
+  console.log(`bulk is ${(vector / bulk).toFixed(1)}x, bulkView ${(vector / view).toFixed(1)}x the vector binding`);
+  irc.delete();
+});
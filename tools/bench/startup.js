@@ -0,0 +1,107 @@
+// Compares builds by what a page pays before the client is useful: download size (raw, gzip, brotli),
+// compile time of the .wasm and time from loading the glue to the first parsed message.
+// Time to first message is measured in a fresh node process per run so nothing is cached between runs.
+//
+//  usage: node tools/bench/startup.js [glue.js ...] [--runs n]
+//
+// defaults to the three builds: ./wasm (make), ./wasm/lean (make lean), ./wasm/capi (make lean-capi),
+// builds that are missing are skipped. No server connection is made
+const path = require('path');
+const fs = require('fs');
+const zlib = require('zlib');
+const { execFileSync } = require('child_process');
+
+const LINE = ':nick!user@host PRIVMSG #bench :first message\r\n';
+
+// child: load one build and report how long it took to parse one line
+async function child(glue) {
+  const start = performance.now();
+  const Module = require(path.resolve(glue));
+  const module = await Module();
+  const ready = performance.now();
+  let first;
+  if (module.ircController) {
+    const irc = new module.ircController();
+    irc.setDebug(false);
+    irc.receive(LINE);
+    first = irc.getNextMessage();
+  } else {
+    const create = module.cwrap('irc_create', 'number', ['number']);
+    const receive = module.cwrap('irc_receive', null, ['number', 'string', 'number']);
+    const next = module.cwrap('irc_next_message', 'string', ['number']);
+    const irc = create(0);
+    receive(irc, LINE, LINE.length);
+    first = next(irc);
+  }
+  const end = performance.now();
+  if (!first) throw new Error(`${glue}: no message parsed`);
+  process.stdout.write(JSON.stringify({ instantiate: ready - start, first: end - start }));
+}
+
+function median(values) {
+  const sorted = values.slice().sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+async function compileTime(bytes, runs) {
+  const times = [];
+  for (let i = 0; i < runs; i++) {
+    const start = performance.now();
+    await WebAssembly.compile(bytes);
+    times.push(performance.now() - start);
+  }
+  return median(times);
+}
+
+function kb(bytes) {
+  return (bytes / 1024).toFixed(1).padStart(8);
+}
+
+function ms(value) {
+  return value.toFixed(2).padStart(9);
+}
+
+async function main() {
+  const argv = process.argv.slice(2);
+  if (argv[0] === '--child') return child(argv[1]);
+
+  let runs = 9;
+  const runsAt = argv.indexOf('--runs');
+  if (runsAt >= 0) {
+    runs = parseInt(argv[runsAt + 1], 10);
+    argv.splice(runsAt, 2);
+  }
+  const builds = argv.length ? argv : ['wasm/ircppwasm.js', 'wasm/lean/ircppwasm.js', 'wasm/capi/ircppwasm.js'].map((f) => path.join(__dirname, '../..', f));
+
+  console.log(`median of ${runs} runs, sizes in KiB, times in ms`);
+  console.log(`${'build'.padEnd(28)}${'glue'.padStart(8)}${'wasm'.padStart(8)}${'gzip'.padStart(8)}${'brotli'.padStart(8)}${'compile'.padStart(9)}${'ready'.padStart(9)}${'first'.padStart(9)}`);
+  for (const glue of builds) {
+    const wasm = glue.replace(/\.js$/, '.wasm');
+    if (!fs.existsSync(glue) || !fs.existsSync(wasm)) {
+      console.log(`${path.relative(process.cwd(), glue).padEnd(28)} missing, skipped`);
+      continue;
+    }
+    const bytes = fs.readFileSync(wasm);
+    const glueBytes = fs.readFileSync(glue);
+    const download = Buffer.concat([glueBytes, bytes]);
+    const gzip = zlib.gzipSync(download, { level: 9 }).length;
+    const brotli = zlib.brotliCompressSync(download, { params: { [zlib.constants.BROTLI_PARAM_QUALITY]: 11 } }).length;
+    const compile = await compileTime(bytes, runs);
+
+    const ready = [];
+    const first = [];
+    for (let i = 0; i < runs; i++) {
+      const out = JSON.parse(execFileSync(process.execPath, [__filename, '--child', glue]).toString());
+      ready.push(out.instantiate);
+      first.push(out.first);
+    }
+    console.log(`${path.relative(process.cwd(), glue).padEnd(28)}${kb(glueBytes.length)}${kb(bytes.length)}${kb(gzip)}${kb(brotli)}${ms(compile)}${ms(median(ready))}${ms(median(first))}`);
+  }
+  console.log('gzip and brotli are of glue and wasm together, ready is require() to Module() resolved,');
+  console.log('first is require() to the first PRIVMSG returned by getNextMessage');
+}
+
+main().catch((e) => {
+  console.error(e.message);
+  process.exit(1);
+});
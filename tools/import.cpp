@@ -0,0 +1,248 @@
+// Imports archives of raw IRC lines into the on-disk history log read by ircController::getHistory.
+// Files are parsed on a pool of threads with message::parse, each worker interns target names into its own pool
+// and groups lines per target, the groups are then merged in time order and appended to the log.
+//
+//  usage: import [-j <threads>] [--nick <nick>] [--casemapping <mapping>] [--round <files>] <log dir> <file>...
+//
+//  -j             worker threads, default is one per core
+//  --nick         our nick in the archive, queries we sent are filed under the other side
+//  --casemapping  ascii, rfc1459 (default) or strict-rfc1459, how target names are folded
+//  --round        files parsed per round, bounds memory, default 16 per thread
+//
+// Lines are raw protocol lines, optionally preceded by a unix timestamp in seconds or ms or an IRCv3 @time tag.
+// Lines without a time take the one before them, or the file's modification time.
+// Files are handled in name order so archives named by date keep their order across rounds
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/internPool.hpp"
+#include "../include/isupport.hpp"
+#include "../include/message.hpp"
+#include "../include/messageLog.hpp"
+
+// one parsed line of a target, its text lives in the worker's buffer
+struct entry {
+    uint64_t time;
+    uint32_t file, offset, length;
+};
+
+// what a worker made of its files in a round
+struct shard {
+    internPool pool;
+    std::vector<std::vector<entry>> targets;  // by pool id - 1
+    std::vector<std::string> buffers;         // file contents, by file index within the round
+    uint64_t lines = 0, logged = 0, bytes = 0;
+};
+
+static void usage() {
+    std::fprintf(stderr, "usage: import [-j <threads>] [--nick <nick>] [--casemapping <mapping>] [--round <files>] <log dir> <file>...\n");
+    std::exit(2);
+}
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool readFile(const std::string &path, std::string &out) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    out.resize(size > 0 ? size : 0);
+    size_t read = out.size() ? std::fread(&out[0], 1, out.size(), file) : 0;
+    std::fclose(file);
+    out.resize(read);
+    return true;
+}
+
+// strips a leading timestamp or tag block, returns the time it carried or 0
+static uint64_t stripTime(std::string_view &line) {
+    uint64_t time = 0;
+    if (line.size() && line[0] == '@') {
+        size_t space = line.find(' ');
+        std::string_view tags = line.substr(1, space == std::string_view::npos ? space : space - 1);
+        size_t at = tags.find("time=");
+        if (at != std::string_view::npos && (at == 0 || tags[at - 1] == ';')) time = message::isoTime(tags.substr(at + 5, tags.find(';', at) - at - 5));
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    } else if (line.size() && std::isdigit((unsigned char)line[0])) {
+        size_t space = line.find(' ');
+        std::string_view stamp = line.substr(0, space);
+        // a numeric command such as 001 has no prefix but is only three digits
+        if (space == std::string_view::npos || stamp.size() < 9 || stamp.find_first_not_of("0123456789.") != std::string_view::npos) return 0;
+        double value = std::atof(std::string(stamp).c_str());
+        time = value > 1e11 ? (uint64_t)value : (uint64_t)(value * 1000);
+        line = line.substr(space + 1);
+    }
+    return time;
+}
+
+// parses every file of a round this worker takes, files are shared out through next
+static void work(const std::vector<std::string> &files, size_t first, size_t count, std::atomic<size_t> &next, shard &out,
+                 const isupport &settings, const std::string &nick) {
+    out.pool.setCasemapping(settings.foldTable());
+    message m("");
+    for (size_t i = next++; i < count; i = next++) {
+        std::string &buffer = out.buffers[i];
+        if (!readFile(files[first + i], buffer)) {
+            std::fprintf(stderr, "import: cannot read %s\n", files[first + i].c_str());
+            continue;
+        }
+        struct stat st;
+        uint64_t time = stat(files[first + i].c_str(), &st) == 0 ? (uint64_t)st.st_mtime * 1000 : 0;
+        out.bytes += buffer.size();
+        size_t start = 0;
+        while (start < buffer.size()) {
+            size_t end = buffer.find('\n', start);
+            if (end == std::string::npos) end = buffer.size();
+            std::string_view line(buffer.data() + start, end - start);
+            if (line.size() && line.back() == '\r') line.remove_suffix(1);
+            start = end + 1;
+            uint64_t stamp = stripTime(line);
+            if (stamp) time = stamp;
+            if (line.empty()) continue;
+            out.lines++;
+            m.parse(line);
+            std::string_view target = messageLog::targetOf(m, settings, nick);
+            if (target.empty()) continue;
+            uint32_t id = out.pool.find(target);
+            if (!id) id = out.pool.intern(target);
+            if (out.targets.size() < id) out.targets.resize(id);
+            out.targets[id - 1].push_back({time, (uint32_t)i, (uint32_t)(line.data() - buffer.data()), (uint32_t)line.size()});
+            out.logged++;
+        }
+    }
+}
+
+// appends a parsed round to the log, the same target from every shard merged in time order, file order breaking ties
+static void merge(std::vector<shard> &shards, messageLog &log, const isupport &settings, uint64_t &ns) {
+    uint64_t start = nowNs();
+    std::vector<std::pair<std::string, std::vector<std::pair<size_t, uint32_t>>>> names;  // folded name, (shard, id)
+    internPool all;
+    all.setCasemapping(settings.foldTable());
+    for (size_t s = 0; s < shards.size(); s++) {
+        for (uint32_t id = 1; id <= shards[s].targets.size(); id++) {
+            std::string_view name = shards[s].pool.view(id);
+            uint32_t merged = all.find(name);
+            if (!merged) {
+                merged = all.intern(name);
+                if (names.size() < merged) names.resize(merged);
+                names[merged - 1].first = std::string(name);
+            }
+            names[merged - 1].second.push_back({s, id});
+        }
+    }
+    for (auto it = names.begin(); it != names.end(); it++) {
+        std::vector<std::pair<const entry *, const shard *>> merged;
+        for (auto part = it->second.begin(); part != it->second.end(); part++) {
+            const shard &sh = shards[part->first];
+            const std::vector<entry> &list = sh.targets[part->second - 1];
+            for (auto e = list.begin(); e != list.end(); e++) merged.push_back({&*e, &sh});
+        }
+        std::stable_sort(merged.begin(), merged.end(), [](const std::pair<const entry *, const shard *> &a, const std::pair<const entry *, const shard *> &b) {
+            if (a.first->time != b.first->time) return a.first->time < b.first->time;
+            if (a.first->file != b.first->file) return a.first->file < b.first->file;
+            return a.first->offset < b.first->offset;
+        });
+        for (auto e = merged.begin(); e != merged.end(); e++) {
+            const std::string &buffer = e->second->buffers[e->first->file];
+            log.append(it->first, std::string_view(buffer.data() + e->first->offset, e->first->length), e->first->time);
+        }
+        log.flush();
+    }
+    ns += nowNs() - start;
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency()), round = 0;
+    std::string nick, dir;
+    isupport settings;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--nick") && i + 1 < argc) {
+            nick = argv[++i];
+        } else if (!std::strcmp(argv[i], "--casemapping") && i + 1 < argc) {
+            std::string mapping = argv[++i];
+            if (mapping == "ascii") {
+                settings.mapping = isupport::ASCII;
+            } else if (mapping == "strict-rfc1459") {
+                settings.mapping = isupport::STRICT_RFC1459;
+            } else if (mapping != "rfc1459") {
+                usage();
+            }
+        } else if (!std::strcmp(argv[i], "--round") && i + 1 < argc) {
+            round = std::max(1, std::atoi(argv[++i]));
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else if (dir.empty()) {
+            dir = argv[i];
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (dir.empty() || files.empty()) usage();
+    if (!round) round = threads * 16;
+    std::sort(files.begin(), files.end());
+
+    messageLog log;
+    log.setCasemapping(settings.foldTable());
+    if (!log.open(dir)) {
+        std::fprintf(stderr, "import: cannot open log %s\n", dir.c_str());
+        return 1;
+    }
+
+    uint64_t lines = 0, logged = 0, bytes = 0, parseNs = 0, mergeNs = 0;
+    uint64_t begin = nowNs();
+    // a round is merged into the log on its own thread while the next one is parsed
+    std::vector<shard> merging;
+    std::thread writer;
+    for (size_t first = 0; first < files.size(); first += round) {
+        size_t count = std::min(round, files.size() - first);
+        std::vector<shard> shards(std::min(threads, count));
+        for (auto it = shards.begin(); it != shards.end(); it++) it->buffers.resize(count);
+
+        uint64_t start = nowNs();
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < shards.size(); t++) {
+            pool.emplace_back(work, std::cref(files), first, count, std::ref(next), std::ref(shards[t]), std::cref(settings), std::cref(nick));
+        }
+        for (auto it = pool.begin(); it != pool.end(); it++) it->join();
+        parseNs += nowNs() - start;
+        for (auto it = shards.begin(); it != shards.end(); it++) {
+            lines += it->lines;
+            logged += it->logged;
+            bytes += it->bytes;
+        }
+
+        if (writer.joinable()) writer.join();
+        merging.swap(shards);
+        writer = std::thread(merge, std::ref(merging), std::ref(log), std::cref(settings), std::ref(mergeNs));
+    }
+    if (writer.joinable()) writer.join();
+    log.close();
+
+    double elapsed = (nowNs() - begin) / 1e9;
+    std::printf("files        %zu\n", files.size());
+    std::printf("threads      %zu\n", threads);
+    std::printf("lines        %llu (%llu logged)\n", (unsigned long long)lines, (unsigned long long)logged);
+    std::printf("input        %.1f MiB\n", bytes / 1048576.0);
+    std::printf("elapsed      %.3f s\n", elapsed);
+    std::printf("parse        %.3f s  %.0f lines/s\n", parseNs / 1e9, parseNs ? lines / (parseNs / 1e9) : 0.0);
+    std::printf("merge        %.3f s  overlapped with parsing\n", mergeNs / 1e9);
+    std::printf("throughput   %.0f lines/s\n", elapsed > 0 ? lines / elapsed : 0.0);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Replays a capture made with ircController::startCapture through the framing, parsing and
+// categorizeMsg pipeline and reports throughput, per-stage latency and peak heap.
+//
+//  usage: replay [--realtime] [--repeat <n>] [--no-stages] [--keep] [--slice <ms>] [--snapshot <path>] <capture>
+//
+//  --realtime   sleep between lines to reproduce recorded timing, default is as fast as possible
+//  --repeat     replay the capture n times
+//  --no-stages  do not time individual stages, measures the pipeline without profiling overhead
+//  --keep       do not drain message queues, like a UI that never reads
+//  --slice      queue lines and handle them in slices of at most ms, like setIngestBudget in the browser.
+//               Lines arriving within 1 ms of each other are one burst, its slices are run once it ends
+//  --snapshot   afterwards saves every controller to path, restores it into a new one and forgets that again,
+//               which must leave no interned name referenced. Exits with 1 if one is
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../include/capture.hpp"
+#include "../include/ircController.hpp"
+
+// heap in use as malloc reports it, sampled between lines so the measurement stays out of the hot path
+static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return (size_t)mallinfo().uordblks;
+#endif
+}
+
+// lines between two heap samples
+static const size_t sampleEvery = 256;
+
+static void usage() {
+    std::fprintf(stderr, "usage: replay [--realtime] [--repeat <n>] [--no-stages] [--keep] [--slice <ms>] [--snapshot <path>] <capture>\n");
+    std::exit(2);
+}
+
+static double perLine(uint64_t ns, uint64_t lines) {
+    return lines ? (double)ns / lines : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    bool realtime = false, stagesOn = true, keep = false;
+    int repeat = 1;
+    double slice = 0;
+    const char *path = nullptr, *snapshotPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--realtime")) {
+            realtime = true;
+        } else if (!std::strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--no-stages")) {
+            stagesOn = false;
+        } else if (!std::strcmp(argv[i], "--keep")) {
+            keep = true;
+        } else if (!std::strcmp(argv[i], "--slice") && i + 1 < argc) {
+            slice = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        } else if (argv[i][0] == '-' || path) {
+            usage();
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) usage();
+
+    // load everything up front so disk reads stay out of the measurement
+    std::vector<capture::record> records;
+    capture::reader in;
+    if (!in.open(path)) {
+        std::fprintf(stderr, "replay: %s is not a readable capture\n", path);
+        return 1;
+    }
+    capture::record rec;
+    while (in.next(rec)) records.push_back(rec);
+    if (records.empty()) {
+        std::fprintf(stderr, "replay: %s has no records\n", path);
+        return 1;
+    }
+
+    // one controller per recorded connection, outgoing lines (PONG...) are dropped
+    std::map<uint32_t, std::unique_ptr<ircController>> controllers;
+    for (auto it = records.begin(); it != records.end(); it++) {
+        auto &c = controllers[it->connection];
+        if (c) continue;
+        c.reset(new ircController(false));
+        c->sink = [](const std::string &) {};
+        c->setProfiling(stagesOn);
+        c->setIngestBudget(slice);
+    }
+
+    // with --slice, runs every controller's queued lines slice by slice and records how long each took
+    std::vector<uint32_t> slices;
+    auto runSlices = [&]() {
+        for (auto it = controllers.begin(); it != controllers.end(); it++) {
+            ircController &c = *it->second;
+            while (true) {
+                auto t0 = std::chrono::steady_clock::now();
+                if (!c.runSlice()) break;
+                auto t1 = std::chrono::steady_clock::now();
+                slices.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                if (!keep) {
+                    while (c.getNextMessage().size()) {
+                    }
+                    while (c.getNextInfoMessage().size()) {
+                    }
+                }
+            }
+        }
+    };
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(records.size() * repeat);
+    size_t baseline = heapInUse(), peakBytes = baseline, sampled = 0;
+    auto sample = [&]() { peakBytes = std::max(peakBytes, heapInUse()); };
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        auto pass = std::chrono::steady_clock::now();
+        for (auto it = records.begin(); it != records.end(); it++) {
+            if (realtime) std::this_thread::sleep_until(pass + std::chrono::microseconds(it->time));
+            if (slice > 0 && it != records.begin() && it->time > (it - 1)->time + 1000) runSlices();
+            ircController &c = *controllers[it->connection];
+            auto t0 = std::chrono::steady_clock::now();
+            c.ingest(it->line.data(), it->line.size());
+            if (!keep) {
+                while (c.getNextMessage().size()) {
+                }
+                while (c.getNextInfoMessage().size()) {
+                }
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            latencies.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            if (++sampled % sampleEvery == 0) sample();
+        }
+        if (slice > 0) runSlices();
+        sample();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+    size_t total = latencies.size();
+
+    std::printf("capture      %s\n", path);
+    std::printf("connections  %zu\n", controllers.size());
+    std::printf("lines        %zu (%zu x %d)\n", total, records.size(), repeat);
+    std::printf("elapsed      %.3f s\n", seconds);
+    std::printf("throughput   %.0f msg/s\n", total / seconds);
+    std::printf("latency      p50 %u ns  p99 %u ns  p99.9 %u ns  max %u ns\n", pct(0.5), pct(0.99), pct(0.999), latencies.back());
+    if (slice > 0 && slices.size()) {
+        std::sort(slices.begin(), slices.end());
+        std::printf("slices       %zu  p50 %u ns  p99 %u ns  max %u ns (budget %.0f ns)\n", slices.size(),
+                    slices[slices.size() / 2], slices[std::min(slices.size() - 1, (size_t)(0.99 * slices.size()))],
+                    slices.back(), slice * 1e6);
+    }
+    if (stagesOn) {
+        ircController::stageTimes sum = {};
+        for (auto it = controllers.begin(); it != controllers.end(); it++) {
+            const ircController::stageTimes &s = it->second->stages;
+            sum.framing += s.framing;
+            sum.decoding += s.decoding;
+            sum.parsing += s.parsing;
+            sum.dispatching += s.dispatching;
+            sum.lines += s.lines;
+        }
+        std::printf("stages/line  framing %.0f ns  decoding %.0f ns  parsing %.0f ns  dispatching %.0f ns\n",
+                    perLine(sum.framing, sum.lines), perLine(sum.decoding, sum.lines),
+                    perLine(sum.parsing, sum.lines), perLine(sum.dispatching, sum.lines));
+    }
+    std::printf("peak heap    %zu bytes above loaded capture and controllers, sampled every %zu lines\n", peakBytes - baseline, sampleEvery);
+    if (!snapshotPath) return 0;
+
+    size_t leaked = 0, saved = 0;
+    for (auto it = controllers.begin(); it != controllers.end(); it++) {
+        if (!it->second->saveSnapshot(snapshotPath)) continue;
+        ircController restored(false);
+        if (!restored.restoreSnapshot(snapshotPath)) continue;
+        saved++;
+        leaked += restored.forget();
+    }
+    std::printf("snapshot     %zu of %zu restored, %zu names left referenced after forget\n", saved, controllers.size(), leaked);
+    return saved == controllers.size() && !leaked ? 0 : 1;
+}
@@ -0,0 +1,723 @@
+// Local stand-in for an IRC server with a synthetic load generator, for soak testing the client
+// without a real inspircd. Speaks plain IRC over TCP and IRC over WebSocket (one line per frame).
+//
+//  usage: stubserver [options]
+//
+//  --port <n>          plain IRC port, default 6667
+//  --ws-port <n>       WebSocket port, default 7002
+//  --rate <n>          synthetic PRIVMSGs per second across all load channels, default 0
+//  --channels <n>      number of load channels (#load0...), default 10
+//  --members <n>       synthetic members per load channel, default 100
+//  --split-every <s>   netsplit every s seconds, default 0 (never)
+//  --split-size <n>    synthetic users quitting on each netsplit, default 50
+//  --split-heal <s>    seconds until split users join back, default 5
+//  --ping <s>          server PING interval, default 30
+//  --autojoin          join every load channel on registration
+//  --binary            send binary instead of text WebSocket frames
+//  --report <s>        print statistics every s seconds, default 5
+//  --duration <s>      exit after s seconds, default 0 (run forever)
+//
+// Handles registration (PASS/NICK/USER/CAP), JOIN, PART, NAMES, PRIVMSG/NOTICE fan-out,
+// PING/PONG, LIST, TOPIC and QUIT. Everything else gets 421.
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+static const char *SERVER = "stub.irc";
+
+struct options {
+    int port = 6667, wsPort = 7002;
+    double rate = 0;
+    int channels = 10, members = 100;
+    int splitEvery = 0, splitSize = 50, splitHeal = 5;
+    int ping = 30, report = 5, duration = 0;
+    bool autojoin = false, binary = false;
+} opts;
+
+struct client {
+    int fd;
+    bool websocket, handshaken, closing;
+    std::string in, out, wsMessage;
+    std::string nick, user, host;
+    bool gotUser;
+    bool registered;
+    std::set<std::string> channels;
+};
+
+struct channel {
+    std::string name, topic;
+    std::set<int> clients;
+    std::vector<std::string> members;  // synthetic
+};
+
+static std::map<int, std::unique_ptr<client>> clients;
+static std::map<std::string, channel> channels;
+static std::vector<std::string> loadChannels;
+static std::vector<std::pair<std::string, std::string>> splitUsers;  // channel, nick waiting to rejoin
+static std::mt19937 rng(1);
+static uint64_t sentLines = 0, sentMessages = 0;
+
+static std::string lower(std::string s) {
+    for (auto it = s.begin(); it != s.end(); it++) *it = std::tolower(*it);
+    return s;
+}
+
+// ---------------------------------------------------------------- sha1 / base64 for the handshake
+
+static std::string sha1(const std::string &data) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string msg = data;
+    uint64_t bits = (uint64_t)data.size() * 8;
+    msg += (char)0x80;
+    while (msg.size() % 64 != 56) msg += (char)0;
+    for (int i = 7; i >= 0; i--) msg += (char)(bits >> (8 * i));
+    auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char *p = (const unsigned char *)&msg[chunk + 4 * i];
+            w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    std::string out;
+    for (int i = 0; i < 5; i++)
+        for (int j = 3; j >= 0; j--) out += (char)(h[i] >> (8 * j));
+    return out;
+}
+
+static std::string base64(const std::string &data) {
+    static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    size_t i = 0;
+    for (; i + 2 < data.size(); i += 3) {
+        uint32_t v = ((unsigned char)data[i] << 16) | ((unsigned char)data[i + 1] << 8) | (unsigned char)data[i + 2];
+        out += table[v >> 18];
+        out += table[(v >> 12) & 63];
+        out += table[(v >> 6) & 63];
+        out += table[v & 63];
+    }
+    if (i + 1 == data.size()) {
+        uint32_t v = (unsigned char)data[i] << 16;
+        out += table[v >> 18];
+        out += table[(v >> 12) & 63];
+        out += "==";
+    } else if (i + 2 == data.size()) {
+        uint32_t v = ((unsigned char)data[i] << 16) | ((unsigned char)data[i + 1] << 8);
+        out += table[v >> 18];
+        out += table[(v >> 12) & 63];
+        out += table[(v >> 6) & 63];
+        out += '=';
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------- output
+
+static void send(client &c, const std::string &line) {
+    sentLines++;
+    if (!c.websocket) {
+        c.out += line;
+        c.out += "\r\n";
+        return;
+    }
+    // server frames are unmasked, one line per frame without CR/LF
+    c.out += (char)(0x80 | (opts.binary ? 0x2 : 0x1));
+    if (line.size() < 126) {
+        c.out += (char)line.size();
+    } else if (line.size() < 65536) {
+        c.out += (char)126;
+        c.out += (char)(line.size() >> 8);
+        c.out += (char)(line.size() & 0xFF);
+    } else {
+        c.out += (char)127;
+        for (int i = 7; i >= 0; i--) c.out += (char)((uint64_t)line.size() >> (8 * i));
+    }
+    c.out += line;
+}
+
+static void numeric(client &c, const char *num, const std::string &rest) {
+    send(c, std::string(":") + SERVER + " " + num + " " + (c.nick.size() ? c.nick : "*") + " " + rest);
+}
+
+static std::string mask(client &c) {
+    return c.nick + "!" + c.user + "@" + c.host;
+}
+
+static void toChannel(channel &ch, const std::string &line, int except = -1) {
+    for (auto it = ch.clients.begin(); it != ch.clients.end(); it++) {
+        if (*it != except) send(*clients[*it], line);
+    }
+}
+
+static void flush(client &c) {
+    while (c.out.size()) {
+        ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            c.closing = true;
+            return;
+        }
+        c.out.erase(0, n);
+    }
+}
+
+// ---------------------------------------------------------------- IRC
+
+static client *findNick(const std::string &nick) {
+    for (auto it = clients.begin(); it != clients.end(); it++) {
+        if (it->second->registered && lower(it->second->nick) == lower(nick)) return it->second.get();
+    }
+    return nullptr;
+}
+
+static std::vector<std::string> split(const std::string &s, char sep) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(sep, start);
+        if (end == std::string::npos) end = s.size();
+        if (end > start) out.push_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+    return out;
+}
+
+static void names(client &c, channel &ch) {
+    std::string line;
+    auto emit = [&]() {
+        numeric(c, "353", "= " + ch.name + " :" + line);
+        line.clear();
+    };
+    for (auto it = ch.clients.begin(); it != ch.clients.end(); it++) {
+        if (line.size() > 400) emit();
+        line += (line.size() ? " " : "") + clients[*it]->nick;
+    }
+    for (auto it = ch.members.begin(); it != ch.members.end(); it++) {
+        if (line.size() > 400) emit();
+        line += (line.size() ? " " : "") + *it;
+    }
+    if (line.size()) emit();
+    numeric(c, "366", ch.name + " :End of /NAMES list.");
+}
+
+static void join(client &c, const std::string &name) {
+    if (name.empty() || name[0] != '#') {
+        numeric(c, "403", name + " :No such channel");
+        return;
+    }
+    channel &ch = channels[lower(name)];
+    if (ch.name.empty()) ch.name = name;
+    if (ch.clients.count(c.fd)) return;
+    ch.clients.insert(c.fd);
+    c.channels.insert(lower(name));
+    toChannel(ch, ":" + mask(c) + " JOIN :" + ch.name);
+    if (ch.topic.size()) numeric(c, "332", ch.name + " :" + ch.topic);
+    names(c, ch);
+}
+
+static void part(client &c, const std::string &key, const std::string &line) {
+    auto found = channels.find(key);
+    if (found == channels.end() || !found->second.clients.count(c.fd)) return;
+    toChannel(found->second, line);
+    found->second.clients.erase(c.fd);
+    c.channels.erase(key);
+}
+
+static void welcome(client &c) {
+    c.registered = true;
+    numeric(c, "001", ":Welcome to the StubNet IRC Network " + mask(c));
+    numeric(c, "002", std::string(":Your host is ") + SERVER + ", running version stubserver");
+    numeric(c, "003", ":This server was created just now");
+    numeric(c, "004", std::string(SERVER) + " stubserver iosw biklmnopstv");
+    numeric(c, "005", "AWAYLEN=200 CASEMAPPING=rfc1459 CHANLIMIT=#:1000 CHANTYPES=# LINELEN=512 MAXTARGETS=20 "
+                      "NETWORK=StubNet NICKLEN=30 PREFIX=(ov)@+ :are supported by this server");
+    numeric(c, "005", "TARGMAX=JOIN:,NAMES:,PRIVMSG:4,NOTICE:4,WHOIS:1 TOPICLEN=307 :are supported by this server");
+    numeric(c, "422", ":There is no MOTD");
+    if (opts.autojoin) {
+        for (auto it = loadChannels.begin(); it != loadChannels.end(); it++) join(c, *it);
+    }
+}
+
+static void command(client &c, const std::string &raw) {
+    std::string line = raw;
+    if (line.size() && line[0] == ':') {
+        size_t sp = line.find(' ');
+        line = (sp == std::string::npos) ? "" : line.substr(sp + 1);
+    }
+    std::vector<std::string> params;
+    while (line.size()) {
+        while (line.size() && line[0] == ' ') line.erase(0, 1);
+        if (line.empty()) break;
+        if (line[0] == ':' && params.size()) {
+            params.push_back(line.substr(1));
+            break;
+        }
+        size_t sp = line.find(' ');
+        params.push_back(line.substr(0, sp));
+        line = (sp == std::string::npos) ? "" : line.substr(sp);
+    }
+    if (params.empty()) return;
+    std::string cmd = params[0];
+    for (auto it = cmd.begin(); it != cmd.end(); it++) *it = std::toupper(*it);
+    params.erase(params.begin());
+
+    if (cmd == "PASS" || cmd == "PONG") {
+        return;
+    } else if (cmd == "CAP") {
+        if (params.size() && params[0] == "LS") send(c, std::string(":") + SERVER + " CAP * LS :");
+        return;
+    } else if (cmd == "NICK") {
+        if (params.empty()) return numeric(c, "431", ":No nickname given");
+        client *other = findNick(params[0]);
+        if (other && other != &c) return numeric(c, "433", params[0] + " :Nickname is already in use");
+        if (c.registered) {
+            std::string line = ":" + mask(c) + " NICK :" + params[0];
+            send(c, line);
+            for (auto it = c.channels.begin(); it != c.channels.end(); it++) toChannel(channels[*it], line, c.fd);
+        }
+        c.nick = params[0];
+        if (!c.registered && c.gotUser) welcome(c);
+        return;
+    } else if (cmd == "USER") {
+        if (params.size() < 4) return numeric(c, "461", "USER :Not enough parameters");
+        c.user = params[0];
+        c.gotUser = true;
+        if (!c.registered && c.nick.size()) welcome(c);
+        return;
+    } else if (cmd == "PING") {
+        send(c, std::string(":") + SERVER + " PONG " + SERVER + " :" + (params.size() ? params[0] : ""));
+        return;
+    } else if (cmd == "QUIT") {
+        c.closing = true;
+        return;
+    }
+    if (!c.registered) return numeric(c, "451", ":You have not registered");
+
+    if (cmd == "JOIN") {
+        if (params.empty()) return numeric(c, "461", "JOIN :Not enough parameters");
+        std::vector<std::string> names = split(params[0], ',');
+        for (auto it = names.begin(); it != names.end(); it++) join(c, *it);
+    } else if (cmd == "PART") {
+        if (params.empty()) return numeric(c, "461", "PART :Not enough parameters");
+        std::vector<std::string> names = split(params[0], ',');
+        std::string reason = params.size() > 1 ? " :" + params[1] : "";
+        for (auto it = names.begin(); it != names.end(); it++) part(c, lower(*it), ":" + mask(c) + " PART " + *it + reason);
+    } else if (cmd == "NAMES") {
+        if (params.empty()) return numeric(c, "366", "* :End of /NAMES list.");
+        std::vector<std::string> list = split(params[0], ',');
+        for (auto it = list.begin(); it != list.end(); it++) {
+            auto found = channels.find(lower(*it));
+            if (found != channels.end()) {
+                names(c, found->second);
+            } else {
+                numeric(c, "366", *it + " :End of /NAMES list.");
+            }
+        }
+    } else if (cmd == "PRIVMSG" || cmd == "NOTICE") {
+        if (params.size() < 2) return numeric(c, "412", ":No text to send");
+        std::vector<std::string> targets = split(params[0], ',');
+        for (auto it = targets.begin(); it != targets.end(); it++) {
+            std::string line = ":" + mask(c) + " " + cmd + " " + *it + " :" + params[1];
+            if ((*it)[0] == '#') {
+                auto found = channels.find(lower(*it));
+                if (found == channels.end()) {
+                    numeric(c, "403", *it + " :No such channel");
+                } else {
+                    toChannel(found->second, line, c.fd);
+                }
+            } else if (client *other = findNick(*it)) {
+                send(*other, line);
+            } else {
+                numeric(c, "401", *it + " :No such nick");
+            }
+        }
+    } else if (cmd == "LIST") {
+        numeric(c, "321", "Channel :Users Name");
+        for (auto it = channels.begin(); it != channels.end(); it++) {
+            size_t users = it->second.clients.size() + it->second.members.size();
+            numeric(c, "322", it->second.name + " " + std::to_string(users) + " :" + it->second.topic);
+        }
+        numeric(c, "323", ":End of channel list.");
+    } else if (cmd == "TOPIC") {
+        if (params.empty()) return numeric(c, "461", "TOPIC :Not enough parameters");
+        auto found = channels.find(lower(params[0]));
+        if (found == channels.end()) return numeric(c, "403", params[0] + " :No such channel");
+        if (params.size() > 1) {
+            found->second.topic = params[1];
+            toChannel(found->second, ":" + mask(c) + " TOPIC " + found->second.name + " :" + params[1]);
+        } else if (found->second.topic.size()) {
+            numeric(c, "332", found->second.name + " :" + found->second.topic);
+        } else {
+            numeric(c, "331", found->second.name + " :No topic is set");
+        }
+    } else {
+        numeric(c, "421", cmd + " :Unknown command");
+    }
+}
+
+static void disconnect(int fd) {
+    client &c = *clients[fd];
+    if (c.registered) {
+        std::string line = ":" + mask(c) + " QUIT :Client exited";
+        for (auto it = c.channels.begin(); it != c.channels.end(); it++) {
+            channels[*it].clients.erase(fd);
+            toChannel(channels[*it], line);
+        }
+    }
+    close(fd);
+    clients.erase(fd);
+}
+
+// ---------------------------------------------------------------- input
+
+static void lines(client &c, std::string &buffer, bool flushTail) {
+    size_t start = 0, lf;
+    while ((lf = buffer.find('\n', start)) != std::string::npos) {
+        size_t end = (lf > start && buffer[lf - 1] == '\r') ? lf - 1 : lf;
+        if (end > start) command(c, buffer.substr(start, end - start));
+        start = lf + 1;
+    }
+    buffer.erase(0, start);
+    if (flushTail && buffer.size()) {
+        if (buffer.back() == '\r') buffer.pop_back();
+        command(c, buffer);
+        buffer.clear();
+    }
+}
+
+static void handshake(client &c) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    std::string head = c.in.substr(0, end), key;
+    c.in.erase(0, end + 4);
+    std::string lowered = lower(head);
+    size_t pos = lowered.find("sec-websocket-key:");
+    if (pos != std::string::npos) {
+        size_t eol = head.find("\r\n", pos);
+        key = head.substr(pos + 18, eol - pos - 18);
+        key.erase(0, key.find_first_not_of(' '));
+        key.erase(key.find_last_not_of(' ') + 1);
+    }
+    if (key.empty()) {
+        c.out += "HTTP/1.1 400 Bad Request\r\n\r\n";
+        c.closing = true;
+        return;
+    }
+    std::string accept = base64(sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+    c.out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+             "Sec-WebSocket-Accept: " + accept + "\r\n";
+    if (lowered.find("text.ircv3.net") != std::string::npos) c.out += "Sec-WebSocket-Protocol: text.ircv3.net\r\n";
+    c.out += "\r\n";
+    c.handshaken = true;
+    c.host = "websocket.stub";
+}
+
+static void frames(client &c) {
+    while (c.in.size() >= 2) {
+        const unsigned char *p = (const unsigned char *)c.in.data();
+        bool fin = p[0] & 0x80, masked = p[1] & 0x80;
+        int opcode = p[0] & 0x0F;
+        uint64_t len = p[1] & 0x7F;
+        size_t header = 2;
+        if (len == 126) {
+            if (c.in.size() < 4) return;
+            len = (p[2] << 8) | p[3];
+            header = 4;
+        } else if (len == 127) {
+            if (c.in.size() < 10) return;
+            len = 0;
+            for (int i = 0; i < 8; i++) len = (len << 8) | p[2 + i];
+            header = 10;
+        }
+        if (masked) header += 4;
+        if (c.in.size() < header + len) return;
+        std::string payload = c.in.substr(header, len);
+        if (masked) {
+            const unsigned char *key = p + header - 4;
+            for (size_t i = 0; i < payload.size(); i++) payload[i] ^= key[i % 4];
+        }
+        c.in.erase(0, header + len);
+
+        if (opcode == 0x8) {
+            c.out += std::string("\x88\x00", 2);
+            c.closing = true;
+            return;
+        } else if (opcode == 0x9) {
+            c.out += (char)0x8A;
+            c.out += (char)payload.size();
+            c.out += payload;
+        } else if (opcode <= 0x2) {
+            c.wsMessage += payload;
+            if (fin) lines(c, c.wsMessage, true);
+        }
+    }
+}
+
+static void readable(client &c) {
+    char buf[65536];
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        c.closing = true;
+        return;
+    }
+    c.in.append(buf, n);
+    if (!c.websocket) return lines(c, c.in, false);
+    if (!c.handshaken) handshake(c);
+    if (c.handshaken) frames(c);
+}
+
+// ---------------------------------------------------------------- load
+
+static void setupLoad() {
+    for (int i = 0; i < opts.channels; i++) {
+        std::string name = "#load" + std::to_string(i);
+        channel &ch = channels[name];
+        ch.name = name;
+        ch.topic = "synthetic load channel " + std::to_string(i);
+        for (int j = 0; j < opts.members; j++) ch.members.push_back("l" + std::to_string(i) + "u" + std::to_string(j));
+        loadChannels.push_back(name);
+    }
+}
+
+static void generate(uint64_t count) {
+    static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+                                  "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et"};
+    static uint64_t seq = 0;
+    std::vector<channel *> busy;
+    for (auto it = loadChannels.begin(); it != loadChannels.end(); it++) {
+        channel &ch = channels[*it];
+        if (ch.clients.size() && ch.members.size()) busy.push_back(&ch);
+    }
+    if (busy.empty()) return;
+    for (uint64_t i = 0; i < count; i++) {
+        channel &ch = *busy[rng() % busy.size()];
+        const std::string &from = ch.members[rng() % ch.members.size()];
+        std::string text = "load " + std::to_string(seq++);
+        int words_n = 3 + rng() % 20;
+        for (int w = 0; w < words_n; w++) {
+            text += ' ';
+            text += words[rng() % 16];
+        }
+        toChannel(ch, ":" + from + "!" + from + "@load.stub PRIVMSG " + ch.name + " :" + text);
+        sentMessages++;
+    }
+}
+
+static void netsplit() {
+    for (int i = 0; i < opts.splitSize && loadChannels.size(); i++) {
+        channel &ch = channels[loadChannels[rng() % loadChannels.size()]];
+        if (ch.members.empty()) continue;
+        size_t pick = rng() % ch.members.size();
+        std::string nick = ch.members[pick];
+        ch.members.erase(ch.members.begin() + pick);
+        toChannel(ch, ":" + nick + "!" + nick + "@load.stub QUIT :*.net *.split");
+        splitUsers.push_back({lower(ch.name), nick});
+    }
+}
+
+static void heal() {
+    for (auto it = splitUsers.begin(); it != splitUsers.end(); it++) {
+        channel &ch = channels[it->first];
+        ch.members.push_back(it->second);
+        toChannel(ch, ":" + it->second + "!" + it->second + "@load.stub JOIN :" + ch.name);
+    }
+    splitUsers.clear();
+}
+
+// ---------------------------------------------------------------- main
+
+static int listenOn(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+        std::fprintf(stderr, "stubserver: cannot listen on port %d: %s\n", port, std::strerror(errno));
+        std::exit(1);
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void accept(int listener, bool websocket) {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = ::accept(listener, (sockaddr *)&addr, &len);
+    if (fd < 0) return;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    client *c = new client();
+    c->fd = fd;
+    c->websocket = websocket;
+    c->handshaken = c->closing = c->gotUser = c->registered = false;
+    c->host = inet_ntoa(addr.sin_addr);
+    clients[fd].reset(c);
+}
+
+static void usage() {
+    std::fprintf(stderr,
+                 "usage: stubserver [--port n] [--ws-port n] [--rate n] [--channels n] [--members n]\n"
+                 "                  [--split-every s] [--split-size n] [--split-heal s] [--ping s]\n"
+                 "                  [--autojoin] [--binary] [--report s] [--duration s]\n");
+    std::exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--autojoin") {
+            opts.autojoin = true;
+        } else if (arg == "--binary") {
+            opts.binary = true;
+        } else if (!hasValue) {
+            usage();
+        } else if (arg == "--port") {
+            opts.port = std::atoi(argv[++i]);
+        } else if (arg == "--ws-port") {
+            opts.wsPort = std::atoi(argv[++i]);
+        } else if (arg == "--rate") {
+            opts.rate = std::atof(argv[++i]);
+        } else if (arg == "--channels") {
+            opts.channels = std::atoi(argv[++i]);
+        } else if (arg == "--members") {
+            opts.members = std::atoi(argv[++i]);
+        } else if (arg == "--split-every") {
+            opts.splitEvery = std::atoi(argv[++i]);
+        } else if (arg == "--split-size") {
+            opts.splitSize = std::atoi(argv[++i]);
+        } else if (arg == "--split-heal") {
+            opts.splitHeal = std::atoi(argv[++i]);
+        } else if (arg == "--ping") {
+            opts.ping = std::atoi(argv[++i]);
+        } else if (arg == "--report") {
+            opts.report = std::atoi(argv[++i]);
+        } else if (arg == "--duration") {
+            opts.duration = std::atoi(argv[++i]);
+        } else {
+            usage();
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setupLoad();
+    int tcp = listenOn(opts.port), ws = listenOn(opts.wsPort);
+    std::fprintf(stderr, "stubserver: irc on %d, websocket on %d, %.0f msg/s over %d channels x %d members\n",
+                 opts.port, opts.wsPort, opts.rate, opts.channels, opts.members);
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now(), lastTick = start, lastReport = start, lastPing = start, lastSplit = start, splitAt = start;
+    double owed = 0;
+    uint64_t reportedMessages = 0;
+
+    while (true) {
+        std::vector<pollfd> fds = {{tcp, POLLIN, 0}, {ws, POLLIN, 0}};
+        for (auto it = clients.begin(); it != clients.end(); it++) {
+            fds.push_back({it->first, (short)(POLLIN | (it->second->out.size() ? POLLOUT : 0)), 0});
+        }
+        poll(fds.data(), fds.size(), 10);
+        if (fds[0].revents & POLLIN) accept(tcp, false);
+        if (fds[1].revents & POLLIN) accept(ws, true);
+        for (size_t i = 2; i < fds.size(); i++) {
+            auto found = clients.find(fds[i].fd);
+            if (found == clients.end()) continue;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) readable(*found->second);
+        }
+
+        auto now = clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastTick).count();
+        lastTick = now;
+        owed += opts.rate * elapsed;
+        if (owed >= 1) {
+            generate((uint64_t)owed);
+            owed -= (uint64_t)owed;
+        }
+        if (opts.splitEvery && now - lastSplit >= std::chrono::seconds(opts.splitEvery)) {
+            heal();
+            netsplit();
+            lastSplit = splitAt = now;
+        }
+        if (splitUsers.size() && now - splitAt >= std::chrono::seconds(opts.splitHeal)) heal();
+        if (opts.ping && now - lastPing >= std::chrono::seconds(opts.ping)) {
+            for (auto it = clients.begin(); it != clients.end(); it++) {
+                if (it->second->registered) send(*it->second, std::string("PING :") + SERVER);
+            }
+            lastPing = now;
+        }
+
+        std::vector<int> closed;
+        size_t backlog = 0;
+        for (auto it = clients.begin(); it != clients.end(); it++) {
+            flush(*it->second);
+            backlog += it->second->out.size();
+            if (it->second->closing) closed.push_back(it->first);
+        }
+        for (auto it = closed.begin(); it != closed.end(); it++) {
+            flush(*clients[*it]);
+            disconnect(*it);
+        }
+
+        if (opts.report && now - lastReport >= std::chrono::seconds(opts.report)) {
+            double span = std::chrono::duration<double>(now - lastReport).count();
+            std::fprintf(stderr, "t=%.0fs clients=%zu load=%.0f msg/s lines=%llu backlog=%zu bytes\n",
+                         std::chrono::duration<double>(now - start).count(), clients.size(),
+                         (sentMessages - reportedMessages) / span, (unsigned long long)sentLines, backlog);
+            reportedMessages = sentMessages;
+            lastReport = now;
+        }
+        if (opts.duration && now - start >= std::chrono::seconds(opts.duration)) break;
+    }
+    return 0;
+}